@@ -0,0 +1,217 @@
+// colormap -- color palettes, map iterators, grids, and PPM export
+// Copyright (C) 2018-2019  Jonas Greitemann
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+#pragma once
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <iostream>
+#include <iterator>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <colormap/pixmap.hpp>
+
+
+namespace colormap {
+
+    // Writes a pixmap in binary format (as `pixmap::write_binary`) while
+    // the pixels are being computed: the calling thread encodes bands of
+    // rows into a small pool of buffers, which a background thread hands to
+    // the stream. Encoding blocks while all buffers are waiting to be
+    // written, so no more than `buffers` bands are ever held in memory.
+    // Errors on the stream end the output and are rethrown by `wait`.
+    template <typename ForwardIterator>
+    struct async_pixmap_writer {
+        using pixmap_type = pixmap<ForwardIterator>;
+
+        async_pixmap_writer (pixmap_type const& pmap, std::ostream & os,
+                             size_t buffers = 2, size_t band_size = 1 << 20)
+            : pmap(pmap), os(os), it(pmap.begin), slots(std::max<size_t>(1, buffers))
+        {
+            size_t row_size = pmap.shape.first * color_type::packed_size();
+            rows_per_band = std::max<size_t>(1, band_size / std::max<size_t>(1, row_size));
+            for (size_t i = 0; i < slots.size(); ++i)
+                released.push_back(i);
+            std::string hdr = pmap.header(true);
+            io = std::thread([this, hdr] { run(hdr); });
+        }
+
+        async_pixmap_writer (async_pixmap_writer const&) = delete;
+        async_pixmap_writer & operator= (async_pixmap_writer const&) = delete;
+
+        // Writes out whatever has been encoded so far, but does not report
+        // errors; call `wait` for that.
+        ~async_pixmap_writer () {
+            close();
+        }
+
+        // Encode the next band of rows and queue it for writing, waiting
+        // for a free buffer first if necessary. Returns whether there are
+        // rows left and the output has not failed. Throws std::logic_error
+        // if rows are left but the writer has been closed by `wait`.
+        bool write_band () {
+            if (done())
+                return false;
+            size_t slot;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                if (closing)
+                    throw std::logic_error("pixmap writer already closed");
+                released_cv.wait(lock, [this] { return !released.empty() || error; });
+                if (error)
+                    return false;
+                slot = released.front();
+                released.pop_front();
+            }
+            size_t rows = std::min(rows_per_band, pmap.shape.second - next_row);
+            encode(slots[slot], rows * pmap.shape.first, packed{});
+            next_row += rows;
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                queued.push_back(slot);
+            }
+            queued_cv.notify_one();
+            return !done();
+        }
+
+        // Encode all remaining rows, then wait for them to be written.
+        std::ostream & write () {
+            while (write_band());
+            return wait();
+        }
+
+        // Wait until all queued bands are written and stop the background
+        // thread. Rethrows the first error raised while writing.
+        std::ostream & wait () {
+            close();
+            if (error)
+                std::rethrow_exception(error);
+            return os;
+        }
+
+        // number of bands encoded but not yet written
+        size_t pending () const {
+            std::lock_guard<std::mutex> lock(mutex);
+            return queued.size() + (writing ? 1 : 0);
+        }
+
+        bool done () const {
+            std::lock_guard<std::mutex> lock(mutex);
+            return next_row >= pmap.shape.second || error;
+        }
+
+    private:
+        using color_type = typename pixmap_type::color_type;
+        using packed = typename pixmap_type::packed;
+
+        // Encoded rows: either in `buffer` or, if the pixels are stored as
+        // in the file already, directly in the pixmap's memory.
+        struct band {
+            std::vector<char> buffer;
+            char const * data;
+            size_t size;
+        };
+
+        void encode (band & b, size_t count, std::true_type) {
+            b.data = count > 0 ? reinterpret_cast<char const *>(&*it) : nullptr;
+            b.size = count * color_type::packed_size();
+            std::advance(it, count);
+        }
+
+        void encode (band & b, size_t count, std::false_type) {
+            b.buffer.resize(count * color_type::packed_size());
+            b.data = b.buffer.data();
+            b.size = pmap.encode(it, count, b.buffer.data(), std::false_type{}) - b.data;
+        }
+
+        void run (std::string const& hdr) {
+            try {
+                os.write(hdr.data(), hdr.size());
+                check_stream();
+                for (;;) {
+                    size_t slot;
+                    {
+                        std::unique_lock<std::mutex> lock(mutex);
+                        queued_cv.wait(lock, [this] { return !queued.empty() || closing; });
+                        if (queued.empty())
+                            break;
+                        slot = queued.front();
+                        queued.pop_front();
+                        writing = true;
+                    }
+                    os.write(slots[slot].data, slots[slot].size);
+                    check_stream();
+                    {
+                        std::lock_guard<std::mutex> lock(mutex);
+                        writing = false;
+                        released.push_back(slot);
+                    }
+                    released_cv.notify_one();
+                }
+                os.flush();
+                check_stream();
+            } catch (...) {
+                std::lock_guard<std::mutex> lock(mutex);
+                error = std::current_exception();
+                writing = false;
+                queued.clear();
+            }
+            released_cv.notify_all();
+        }
+
+        void check_stream () {
+            if (!os)
+                throw std::runtime_error("failed to write pixmap");
+        }
+
+        void close () {
+            if (!io.joinable())
+                return;
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                closing = true;
+            }
+            queued_cv.notify_one();
+            io.join();
+        }
+
+        pixmap_type pmap;
+        std::ostream & os;
+        ForwardIterator it;
+        size_t rows_per_band;
+        size_t next_row = 0;
+        std::vector<band> slots;
+
+        mutable std::mutex mutex;
+        std::condition_variable queued_cv;
+        std::condition_variable released_cv;
+        std::deque<size_t> queued;
+        std::deque<size_t> released;
+        bool writing = false;
+        bool closing = false;
+        std::exception_ptr error;
+        std::thread io;
+    };
+
+}
@@ -0,0 +1,147 @@
+// colormap -- color palettes, map iterators, grids, and PPM export
+// Copyright (C) 2018-2019  Jonas Greitemann
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+#pragma once
+
+#include <cstdint>
+#include <initializer_list>
+#include <stdexcept>
+#include <type_traits>
+#include <vector>
+
+#include <colormap/color.hpp>
+#include <colormap/detail/aligned_allocator.hpp>
+#include <colormap/detail/batch.hpp>
+
+
+namespace colormap {
+
+    // How a categorical map treats labels outside [0, size()): either cycle
+    // through the colors again or repeat the first or last color.
+    enum class category_policy { wrap, clamp };
+
+    // A map from integer class labels to colors, without interpolation, as
+    // suitable for qualitative palettes such as `accent` or `set1`. Obtained
+    // from `map::categorical` or constructed from a list of colors.
+    template <typename Color>
+    struct categorical_map {
+        using color_type = Color;
+        using table_type = std::vector<Color, detail::aligned_allocator<Color>>;
+
+        categorical_map (std::initializer_list<Color> il,
+                         category_policy policy = category_policy::wrap)
+            : categorical_map(il.begin(), il.end(), policy) {}
+
+        template <typename ForwardIterator,
+                  typename = decltype(*std::declval<ForwardIterator&>())>
+        categorical_map (ForwardIterator first, ForwardIterator last,
+                         category_policy policy = category_policy::wrap)
+            : table(first, last), policy_(policy)
+        {
+            if (table.empty())
+                throw std::runtime_error("categorical map needs at least 1 color");
+            pack(gatherable{});
+        }
+
+        template <typename Int,
+                  typename = typename std::enable_if<std::is_integral<Int>::value>::type>
+        Color operator() (Int label) const {
+            return table[index(label)];
+        }
+
+        // position of the color of `label` within `colors()`
+        template <typename Int,
+                  typename = typename std::enable_if<std::is_integral<Int>::value>::type>
+        size_t index (Int label) const {
+            return detail::category_index(label, table.size(), wrap());
+        }
+
+        // Batch lookup: out[i] = (*this)(in[i]) for i in [0, n). Uses AVX2
+        // gathers (selected at runtime) for 8-bit RGB(A) colors and labels
+        // of up to 32 bits.
+        template <typename Int>
+        void apply (Int const * in, Color * out, size_t n) const {
+            using simd = std::integral_constant<bool,
+                gatherable::value && std::is_integral<Int>::value && sizeof(Int) <= 4>;
+            detail::categorical_batch(table.data(), packed_data(), table.size(), wrap(),
+                                      in, out, n, simd{});
+        }
+
+        template <typename Input, typename Output>
+        auto apply (Input const& in, Output && out) const
+            -> decltype(in.data(), out.data(), void())
+        {
+            if (out.size() < in.size())
+                throw std::length_error("output range smaller than input range");
+            apply(in.data(), out.data(), in.size());
+        }
+
+        // Indexed-color output: out[i] receives the position of the color of
+        // in[i] within `colors()`, e.g. for writing palette-based images.
+        template <typename Int>
+        void apply_indices (Int const * in, std::uint8_t * out, size_t n) const {
+            if (table.size() > 256)
+                throw std::runtime_error("too many colors for 8-bit indices");
+            detail::category_indices(table.size(), wrap(), in, out, n);
+        }
+
+        template <typename Input, typename Output>
+        auto apply_indices (Input const& in, Output && out) const
+            -> decltype(in.data(), out.data(), void())
+        {
+            if (out.size() < in.size())
+                throw std::length_error("output range smaller than input range");
+            apply_indices(in.data(), out.data(), in.size());
+        }
+
+        table_type const& colors () const {
+            return table;
+        }
+
+        size_t size () const {
+            return table.size();
+        }
+
+        category_policy policy () const {
+            return policy_;
+        }
+
+    private:
+        using gatherable = detail::gatherable<Color>;
+
+        bool wrap () const {
+            return policy_ == category_policy::wrap;
+        }
+
+        void pack (std::true_type) {
+            packed = detail::pack_colors(table.data(), table.size());
+        }
+
+        void pack (std::false_type) {}
+
+        std::uint32_t const * packed_data () const {
+            if (packed.empty())
+                return reinterpret_cast<std::uint32_t const *>(table.data());
+            return packed.data();
+        }
+
+        table_type table;
+        std::vector<std::uint32_t, detail::aligned_allocator<std::uint32_t>> packed;
+        category_policy policy_;
+    };
+
+}
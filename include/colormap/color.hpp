@@ -19,11 +19,59 @@
 
 #include <array>
 #include <cstdint>
+#include <cstring>
 #include <iostream>
 #include <limits>
+#include <type_traits>
 
 namespace colormap {
 
+    namespace detail {
+
+        // Channel types which are interpolated in integer arithmetic, with
+        // `bits` bits per channel.
+        template <typename T>
+        struct fixed_point {
+            static constexpr bool enabled = false;
+        };
+
+        template <>
+        struct fixed_point<std::uint8_t> {
+            static constexpr bool enabled = true;
+            static constexpr unsigned bits = 8;
+        };
+
+        template <>
+        struct fixed_point<std::uint16_t> {
+            static constexpr bool enabled = true;
+            static constexpr unsigned bits = 16;
+        };
+
+        // Fractional bits of the interpolation weight, as many as the
+        // products with 16-bit channels leave room for in 64 bits. The
+        // interpolant is then off by less than 2^-32 (2^-40 for 8-bit
+        // channels), so it is rounded to the nearest integer unless it is
+        // that close to a half-integer.
+        constexpr unsigned weight_bits = 47;
+
+        // Quantize the mixing ratio to a weight in [0, 2^weight_bits],
+        // rounding to nearest.
+        inline std::uint64_t fixed_weight (double mix) {
+            const double one = double(std::uint64_t(1) << weight_bits);
+            double w = mix * one + 0.5;
+            w = w > 0. ? w : 0.;
+            w = w < one ? w : one;
+            return std::uint64_t(w);
+        }
+
+        // (1 - w) * a + w * b in fixed point, rounded to nearest
+        inline std::uint32_t fixed_lerp (std::uint32_t a, std::uint32_t b, std::uint64_t w) {
+            const std::uint64_t one = std::uint64_t(1) << weight_bits;
+            return std::uint32_t((a * (one - w) + b * w + (one >> 1)) >> weight_bits);
+        }
+
+    }
+
     enum class space {
         grayscale,
         rgb,
@@ -35,24 +83,37 @@ namespace colormap {
 
     template <typename T>
     struct color<space::grayscale, T> {
-        static T depth () { return std::numeric_limits<T>::max(); }
-        static space color_space () { return space::grayscale; }
+        static constexpr T depth () { return std::numeric_limits<T>::max(); }
+        static constexpr space color_space () { return space::grayscale; }
 
-        color (T v = 0) : val(v) {}
+        constexpr color (T v = 0) : val(v) {}
 
         template <typename Float,
                   typename = typename std::enable_if<std::is_floating_point<Float>::value>::type>
-        color (Float v) : val(v * depth()) {}
+        constexpr color (Float v) : val(v * depth()) {}
 
         color mix (color const& other, double mix) const {
-            return { T(other.val * mix + val * (1. - mix)) };
+            return mix_impl(other, mix,
+                std::integral_constant<bool, detail::fixed_point<T>::enabled>{});
         }
 
         std::ostream & write (std::ostream & os) const {
-            return os.write(reinterpret_cast<char const *>(&val), sizeof(T));
+            char buf[sizeof(T)];
+            write(buf);
+            return os.write(buf, sizeof(T));
         }
 
-        const T& getValue() const { return val; }
+        // Copy the binary representation to `dst` and return the position
+        // past it. As required by the PNM formats, integer samples are
+        // stored most significant byte first.
+        char * write (char * dst) const {
+            return write_impl(dst, std::is_integral<T>{});
+        }
+
+        // number of bytes in the binary representation
+        static constexpr size_t packed_size () { return sizeof(T); }
+
+        constexpr const T& getValue() const { return val; }
         T& getValue() { return val; }
 
         friend std::ostream & operator<< (std::ostream & os, color const& c) {
@@ -60,25 +121,45 @@ namespace colormap {
             return os;
         }
     private:
+        char * write_impl (char * dst, std::true_type) const {
+            using U = typename std::make_unsigned<T>::type;
+            for (size_t i = sizeof(T); i-- > 0; )
+                *dst++ = char(U(val) >> (8 * i));
+            return dst;
+        }
+
+        char * write_impl (char * dst, std::false_type) const {
+            std::memcpy(dst, &val, sizeof(T));
+            return dst + sizeof(T);
+        }
+
+        color mix_impl (color const& other, double mix, std::true_type) const {
+            return { T(detail::fixed_lerp(val, other.val, detail::fixed_weight(mix))) };
+        }
+
+        color mix_impl (color const& other, double mix, std::false_type) const {
+            return { T(other.val * mix + val * (1. - mix)) };
+        }
+
         T val;
     };
 
     template <typename T, size_t N>
     struct basic_color {
-        static T depth () { return std::numeric_limits<T>::max(); }
-        static space color_space () { return space::rgb; }
+        static constexpr T depth () { return std::numeric_limits<T>::max(); }
+        static constexpr space color_space () { return space::rgb; }
 
-        basic_color () : channels {{}} {}
+        constexpr basic_color () : channels {{}} {}
 
-        basic_color (std::array<color<space::grayscale,T>, N> const& chns)
+        constexpr basic_color (std::array<color<space::grayscale,T>, N> const& chns)
             : channels(chns) {}
 
         template <typename Color,
                   typename = typename std::enable_if<std::is_base_of<basic_color, Color>::value>::type>
         Color mix (Color const& other, double mix) const {
             Color mixed;
-            for (size_t i = 0; i < channels.size(); ++i)
-                mixed.channels[i] = channels[i].mix(other.channels[i], mix);
+            mix_channels(mixed.channels, other.channels, mix,
+                std::integral_constant<bool, detail::fixed_point<T>::enabled>{});
             return mixed;
         }
 
@@ -88,14 +169,48 @@ namespace colormap {
             return os;
         }
 
+        char * write (char * dst) const {
+            for (auto const& ch : channels)
+                dst = ch.write(dst);
+            return dst;
+        }
+
+        static constexpr size_t packed_size () { return N * sizeof(T); }
+
         friend std::ostream & operator<< (std::ostream & os, basic_color const& c) {
             for (auto const& ch : c.channels)
                 os << ch;
             return os;
         }
+
+                        color<space::grayscale,T>& getChannel(size_t idx)       { return channels[idx]; }
+        constexpr const color<space::grayscale,T>& getChannel(size_t idx) const { return channels[idx]; }
     protected:
+        using channels_type = std::array<color<space::grayscale,T>,N>;
+
+        // The weight is computed once and shared by all channels. Each
+        // channel then takes its own 64-bit multiply-adds: with 47-bit
+        // weights the products of even 8-bit channels need 56 bits, so no
+        // two of them fit into one word for SWAR arithmetic. (Splitting the
+        // weight into halves would fit two per word, but at twice the
+        // multiplications.) The batch kernels in detail/batch.hpp handle
+        // four colors per SIMD operation instead.
+        void mix_channels (channels_type & mixed, channels_type const& other,
+                           double mix, std::true_type) const {
+            const std::uint64_t w = detail::fixed_weight(mix);
+            for (size_t i = 0; i < N; ++i)
+                mixed[i] = T(detail::fixed_lerp(channels[i].getValue(),
+                                                other[i].getValue(), w));
+        }
+
+        void mix_channels (channels_type & mixed, channels_type const& other,
+                           double mix, std::false_type) const {
+            for (size_t i = 0; i < N; ++i)
+                mixed[i] = channels[i].mix(other[i], mix);
+        }
+
         color<space::grayscale,T>& getColor(size_t idx) { return channels[idx]; }
-        const color<space::grayscale,T>& getColor(size_t idx) const  { return channels[idx]; }
+        constexpr const color<space::grayscale,T>& getColor(size_t idx) const  { return channels[idx]; }
         std::array<color<space::grayscale,T>,N> channels;
     };
 
@@ -104,43 +219,45 @@ namespace colormap {
         using Base = basic_color<T, 3>;
 
         using Base::Base;
-        color (T r, T g, T b) : Base {{{ {r}, {g}, {b} }}} {}
+        constexpr color (T r, T g, T b) : Base {{{ {r}, {g}, {b} }}} {}
 
         template <typename Float,
                   typename = typename std::enable_if<std::is_floating_point<Float>::value>::type>
-        color (Float r, Float g, Float b) : Base {{{ {r}, {g}, {b} }}} {}
+        constexpr color (Float r, Float g, Float b) : Base {{{ {r}, {g}, {b} }}} {}
 
         friend color<space::rgba, T>;
 
-              color<space::grayscale,T>& getRed()         { return Base::getColor(0); }
-        const color<space::grayscale,T>& getRed()   const { return Base::getColor(0); }
-              color<space::grayscale,T>& getGreen()       { return Base::getColor(1); }
-        const color<space::grayscale,T>& getGreen() const { return Base::getColor(1); }
-              color<space::grayscale,T>& getBlue()        { return Base::getColor(2); }
-        const color<space::grayscale,T>& getBlue()  const { return Base::getColor(2); }
+                        color<space::grayscale,T>& getRed()         { return Base::getColor(0); }
+        constexpr const color<space::grayscale,T>& getRed()   const { return Base::getColor(0); }
+                        color<space::grayscale,T>& getGreen()       { return Base::getColor(1); }
+        constexpr const color<space::grayscale,T>& getGreen() const { return Base::getColor(1); }
+                        color<space::grayscale,T>& getBlue()        { return Base::getColor(2); }
+        constexpr const color<space::grayscale,T>& getBlue()  const { return Base::getColor(2); }
     };
 
     template <typename T>
     struct color<space::rgba, T> : public basic_color<T, 4> {
         using Base = basic_color<T, 4>;
 
+        static constexpr space color_space () { return space::rgba; }
+
         using Base::Base;
-        color (T r, T g, T b, T a) : Base {{{ {r}, {g}, {b}, {a} }}} {}
-        color (color<space::rgb, T> const& rgb, T a = std::numeric_limits<T>::max())
+        constexpr color (T r, T g, T b, T a) : Base {{{ {r}, {g}, {b}, {a} }}} {}
+        constexpr color (color<space::rgb, T> const& rgb, T a = std::numeric_limits<T>::max())
             : Base {{{ rgb.channels[0], rgb.channels[1], rgb.channels[2], {a} }}} {}
 
         template <typename Float,
                   typename = typename std::enable_if<std::is_floating_point<Float>::value>::type>
-        color (Float r, Float g, Float b, Float a) : Base {{{ {r}, {g}, {b}, {a} }}} {}
-
-              color<space::grayscale,T>& getRed()          { return Base::getColor(0); }
-        const color<space::grayscale,T>& getRed()    const { return Base::getColor(0); }
-              color<space::grayscale,T>& getGreen()        { return Base::getColor(1); }
-        const color<space::grayscale,T>& getGreen()  const { return Base::getColor(1); }
-              color<space::grayscale,T>& getBlue()         { return Base::getColor(2); }
-        const color<space::grayscale,T>& getBlue()   const { return Base::getColor(2); }
-              color<space::grayscale,T>& getAlpha()        { return Base::getColor(3); }
-        const color<space::grayscale,T>& getAlpha()  const { return Base::getColor(3); }
+        constexpr color (Float r, Float g, Float b, Float a) : Base {{{ {r}, {g}, {b}, {a} }}} {}
+
+                        color<space::grayscale,T>& getRed()          { return Base::getColor(0); }
+        constexpr const color<space::grayscale,T>& getRed()    const { return Base::getColor(0); }
+                        color<space::grayscale,T>& getGreen()        { return Base::getColor(1); }
+        constexpr const color<space::grayscale,T>& getGreen()  const { return Base::getColor(1); }
+                        color<space::grayscale,T>& getBlue()         { return Base::getColor(2); }
+        constexpr const color<space::grayscale,T>& getBlue()   const { return Base::getColor(2); }
+                        color<space::grayscale,T>& getAlpha()        { return Base::getColor(3); }
+        constexpr const color<space::grayscale,T>& getAlpha()  const { return Base::getColor(3); }
     };
 
 }
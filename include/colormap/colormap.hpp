@@ -17,9 +17,14 @@
 
 #pragma once
 
+#include <colormap/async_pixmap_writer.hpp>
 #include <colormap/color.hpp>
+#include <colormap/evaluate.hpp>
 #include <colormap/map.hpp>
 #include <colormap/palettes.hpp>
 #include <colormap/pixmap.hpp>
+#include <colormap/pixmap_view.hpp>
+#include <colormap/png.hpp>
+#include <colormap/thread_pool.hpp>
 
 #include <colormap/itadpt/map_iterator_adapter.hpp>
@@ -0,0 +1,70 @@
+// colormap -- color palettes, map iterators, grids, and PPM export
+// Copyright (C) 2018-2019  Jonas Greitemann
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <new>
+
+
+namespace colormap {
+namespace detail {
+
+    // Minimal allocator handing out storage aligned to `Align` bytes (a cache
+    // line by default). Over-aligned `operator new` is C++17, so the raw
+    // pointer is stashed just in front of the aligned block instead.
+    template <typename T, std::size_t Align = 64>
+    struct aligned_allocator {
+        static_assert((Align & (Align - 1)) == 0, "alignment must be a power of two");
+        static_assert(Align >= alignof(void*), "alignment too small");
+
+        typedef T value_type;
+
+        template <typename U>
+        struct rebind { typedef aligned_allocator<U, Align> other; };
+
+        aligned_allocator () = default;
+
+        template <typename U>
+        aligned_allocator (aligned_allocator<U, Align> const&) {}
+
+        T * allocate (std::size_t n) {
+            std::size_t bytes = n * sizeof(T) + Align + sizeof(void*);
+            void * raw = ::operator new(bytes);
+            std::uintptr_t p = reinterpret_cast<std::uintptr_t>(raw) + sizeof(void*);
+            p = (p + Align - 1) & ~std::uintptr_t(Align - 1);
+            reinterpret_cast<void**>(p)[-1] = raw;
+            return reinterpret_cast<T*>(p);
+        }
+
+        void deallocate (T * p, std::size_t) {
+            if (p)
+                ::operator delete(reinterpret_cast<void**>(p)[-1]);
+        }
+
+        friend bool operator== (aligned_allocator const&, aligned_allocator const&) {
+            return true;
+        }
+
+        friend bool operator!= (aligned_allocator const&, aligned_allocator const&) {
+            return false;
+        }
+    };
+
+}
+}
@@ -0,0 +1,150 @@
+// colormap -- color palettes, map iterators, grids, and PPM export
+// Copyright (C) 2018-2019  Jonas Greitemann
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+
+namespace colormap {
+namespace detail {
+
+    // "00" through "99"
+    inline char const * digit_pairs () {
+        static constexpr char pairs[] =
+            "00010203040506070809101112131415161718192021222324252627282930313233"
+            "34353637383940414243444546474849505152535455565758596061626364656667"
+            "6869707172737475767778798081828384858687888990919293949596979899";
+        return pairs;
+    }
+
+    // Write the decimal digits of v to dst and return the position past them.
+    inline char * format_decimal (std::uint32_t v, char * dst) {
+        char buf[10];
+        char * p = buf + sizeof(buf);
+        while (v >= 100) {
+            p -= 2;
+            std::memcpy(p, digit_pairs() + 2 * (v % 100), 2);
+            v /= 100;
+        }
+        if (v >= 10) {
+            p -= 2;
+            std::memcpy(p, digit_pairs() + 2 * v, 2);
+        } else {
+            *--p = char('0' + v);
+        }
+        size_t n = buf + sizeof(buf) - p;
+        std::memcpy(dst, p, n);
+        return dst + n;
+    }
+
+    // Decimal representations of 0-255, each padded to four bytes with the
+    // number of digits in the last one, so that a byte is formatted by a
+    // single four-byte copy.
+    struct byte_decimals {
+        byte_decimals () {
+            for (unsigned v = 0; v < 256; ++v) {
+                char * end = format_decimal(v, table[v]);
+                table[v][3] = char(end - table[v]);
+            }
+        }
+
+        char table[256][4];
+    };
+
+    inline byte_decimals const& byte_decimal_table () {
+        static const byte_decimals table;
+        return table;
+    }
+
+    // Writes whitespace-separated decimal values for plain PNM formats into
+    // a large buffer which is handed to the stream in chunks. Lines are
+    // wrapped so as not to exceed `max_line` characters.
+    struct ascii_writer {
+        static constexpr size_t max_line = 70;
+
+        ascii_writer (std::ostream & os, size_t capacity = 1 << 16)
+            : os(os), buffer(capacity), pos(0), line(0) {}
+
+        ascii_writer (ascii_writer const&) = delete;
+        ascii_writer & operator= (ascii_writer const&) = delete;
+
+        ~ascii_writer () {
+            flush();
+        }
+
+        void put (std::uint8_t v) {
+            auto const& entry = byte_decimal_table().table[v];
+            size_t len = size_t(entry[3]);
+            separate(len);
+            std::memcpy(buffer.data() + pos, entry, 4);
+            pos += len;
+        }
+
+        template <typename T>
+        void put (T v) {
+            char digits[10];
+            size_t len = format_decimal(std::uint32_t(v), digits) - digits;
+            separate(len);
+            std::memcpy(buffer.data() + pos, digits, len);
+            pos += len;
+        }
+
+        void end_line () {
+            reserve(1);
+            buffer[pos++] = '\n';
+            line = 0;
+        }
+
+        void flush () {
+            os.write(buffer.data(), pos);
+            pos = 0;
+        }
+
+    private:
+        // make room for a value of length len and the separator preceding it
+        void separate (size_t len) {
+            reserve(len + 4);
+            if (line > 0) {
+                if (line + 1 + len > max_line) {
+                    buffer[pos++] = '\n';
+                    line = 0;
+                } else {
+                    buffer[pos++] = ' ';
+                    ++line;
+                }
+            }
+            line += len;
+        }
+
+        void reserve (size_t n) {
+            if (pos + n > buffer.size())
+                flush();
+        }
+
+        std::ostream & os;
+        std::vector<char> buffer;
+        size_t pos;
+        size_t line;
+    };
+
+}
+}
@@ -0,0 +1,642 @@
+// colormap -- color palettes, map iterators, grids, and PPM export
+// Copyright (C) 2018-2019  Jonas Greitemann
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include <colormap/color.hpp>
+#include <colormap/detail/aligned_allocator.hpp>
+
+#if !defined(COLORMAP_NO_SIMD) && (defined(__GNUC__) || defined(__clang__)) \
+    && (defined(__x86_64__) || defined(__i386__))
+#define COLORMAP_X86_DISPATCH 1
+#include <immintrin.h>
+#endif
+
+
+namespace colormap {
+namespace detail {
+
+    // Uniform access to the channels of a color type. Only colors whose
+    // channels are interpolated in fixed point (8- and 16-bit unsigned) take
+    // part in the batched code paths.
+    template <typename Color>
+    struct channel_traits {
+        static constexpr bool batchable = false;
+    };
+
+    template <typename T>
+    struct channel_traits<color<space::grayscale, T>> {
+        using value_type = T;
+        static constexpr size_t count = 1;
+        static constexpr bool batchable = fixed_point<T>::enabled;
+
+        static T get (color<space::grayscale, T> const& c, size_t) {
+            return c.getValue();
+        }
+
+        static color<space::grayscale, T> make (std::int32_t const* v) {
+            return { T(v[0]) };
+        }
+    };
+
+    template <typename T>
+    struct channel_traits<color<space::rgb, T>> {
+        using value_type = T;
+        static constexpr size_t count = 3;
+        static constexpr bool batchable = fixed_point<T>::enabled;
+
+        static T get (color<space::rgb, T> const& c, size_t k) {
+            return c.getChannel(k).getValue();
+        }
+
+        static color<space::rgb, T> make (std::int32_t const* v) {
+            return { T(v[0]), T(v[1]), T(v[2]) };
+        }
+    };
+
+    template <typename T>
+    struct channel_traits<color<space::rgba, T>> {
+        using value_type = T;
+        static constexpr size_t count = 4;
+        static constexpr bool batchable = fixed_point<T>::enabled;
+
+        static T get (color<space::rgba, T> const& c, size_t k) {
+            return c.getChannel(k).getValue();
+        }
+
+        static color<space::rgba, T> make (std::int32_t const* v) {
+            return { T(v[0]), T(v[1]), T(v[2]), T(v[3]) };
+        }
+    };
+
+    // The channel values of `colors`, one contiguous table per channel,
+    // as consumed by `batch_table`.
+    template <typename Color>
+    std::vector<std::int32_t> channel_tables (std::vector<Color> const& colors) {
+        using traits = channel_traits<Color>;
+        const size_t n = colors.size();
+        std::vector<std::int32_t> channels(traits::count * n);
+        for (size_t k = 0; k < traits::count; ++k)
+            for (size_t i = 0; i < n; ++i)
+                channels[k * n + i] = traits::get(colors[i], k);
+        return channels;
+    }
+
+    // Flattened view of a `map` for batch evaluation: the support keys and
+    // the channel tables, which the map keeps around so that setting up a
+    // batch costs nothing. Every code path performs the same floating-point
+    // and fixed-point operations as `map::operator()` and `color::mix` (or
+    // ones with the same exact result), so results are bit-identical.
+    template <typename Color>
+    struct batch_table {
+        using traits = channel_traits<Color>;
+        static constexpr size_t N = traits::count;
+
+        batch_table (std::pair<double,double> range,
+                     std::vector<double> const& keys,
+                     std::vector<std::int32_t> const& channels,
+                     bool uniform)
+            : lo(range.first), width(range.second - range.first),
+              keys(keys.data()), n(keys.size()), uniform(uniform),
+              channels(channels.data()) {}
+
+        // Normalize x and clamp it to the support range, mapping NaN to the
+        // lower end (like `maxpd` does).
+        double clamp (double x) const {
+            x = (x - lo) / width;
+            x = x > keys[0] ? x : keys[0];
+            return x < keys[n-1] ? x : keys[n-1];
+        }
+
+        // Segment index i in [0, n-2] such that keys[i] <= x < keys[i+1], or
+        // n-2 if x is the upper end.
+        size_t segment (double x) const {
+            if (uniform) {
+                size_t i = size_t(x * (n - 1));
+                i = i < n - 2 ? i : n - 2;
+                if (keys[i] > x)
+                    --i;
+                else if (keys[i+1] <= x)
+                    ++i;
+                return i < n - 2 ? i : n - 2;
+            }
+            size_t i = 0;
+            for (size_t len = n - 1; len > 1; ) {
+                size_t half = len / 2;
+                i += (keys[i + half] <= x) ? half : 0;
+                len -= half;
+            }
+            return i;
+        }
+
+        Color operator() (double x) const {
+            x = clamp(x);
+            size_t i = segment(x);
+            double mix = (x - keys[i]) / (keys[i+1] - keys[i]);
+            return lerp(i, fixed_weight(mix));
+        }
+
+        Color lerp (size_t i, std::uint64_t w) const {
+            std::int32_t v[N];
+            for (size_t k = 0; k < N; ++k) {
+                std::int32_t const * ch = channels + k * n;
+                v[k] = std::int32_t(fixed_lerp(ch[i], ch[i+1], w));
+            }
+            return traits::make(v);
+        }
+
+        double lo;
+        double width;
+        double const * keys;
+        size_t n;
+        bool uniform;
+        std::int32_t const * channels;
+    };
+
+#ifdef COLORMAP_X86_DISPATCH
+
+    __attribute__((target("avx2")))
+    inline __m256d load4 (double const * p) {
+        return _mm256_loadu_pd(p);
+    }
+
+    __attribute__((target("avx2")))
+    inline __m256d load4 (float const * p) {
+        return _mm256_cvtps_pd(_mm_loadu_ps(p));
+    }
+
+    // compress a 4 x 64-bit comparison mask to 4 x 32 bit
+    __attribute__((target("avx2")))
+    inline __m128i narrow_mask (__m256d m) {
+        const __m256i even = _mm256_setr_epi32(0, 2, 4, 6, 0, 0, 0, 0);
+        return _mm256_castsi256_si128(
+            _mm256_permutevar8x32_epi32(_mm256_castpd_si256(m), even));
+    }
+
+    template <typename Color, typename Input>
+    __attribute__((target("avx2")))
+    void apply_avx2 (batch_table<Color> const& t,
+                     Input const * in, Color * out, size_t count)
+    {
+        constexpr size_t N = batch_table<Color>::N;
+        double const * keys = t.keys;
+        const size_t n = t.n;
+        const __m256d lo = _mm256_set1_pd(t.lo);
+        const __m256d width = _mm256_set1_pd(t.width);
+        const __m256d k_first = _mm256_set1_pd(keys[0]);
+        const __m256d k_last = _mm256_set1_pd(keys[n-1]);
+        const __m256d n_minus_1 = _mm256_set1_pd(double(n - 1));
+        const __m256d zero_d = _mm256_setzero_pd();
+        const __m256d w_one_d = _mm256_set1_pd(double(std::uint64_t(1) << weight_bits));
+        const __m256d w_half_d = _mm256_set1_pd(0.5);
+        const __m256d magic = _mm256_set1_pd(double(std::uint64_t(1) << 52));
+        const __m256i w_one = _mm256_set1_epi64x(std::int64_t(1) << weight_bits);
+        const __m256i w_half = _mm256_set1_epi64x(std::int64_t(1) << (weight_bits - 1));
+        const __m256i even = _mm256_setr_epi32(0, 2, 4, 6, 0, 0, 0, 0);
+        const __m128i zero = _mm_setzero_si128();
+        const __m128i max_segment = _mm_set1_epi32(std::int32_t(n - 2));
+        // the masked gathers with an all-ones mask load every lane, but unlike
+        // the unmasked ones they take a defined source operand
+        const __m256d all_d = _mm256_castsi256_pd(_mm256_set1_epi64x(-1));
+        const __m128i all = _mm_set1_epi32(-1);
+
+        size_t j = 0;
+        for (; j + 4 <= count; j += 4) {
+            __m256d x = load4(in + j);
+            x = _mm256_div_pd(_mm256_sub_pd(x, lo), width);
+            x = _mm256_min_pd(_mm256_max_pd(x, k_first), k_last);
+
+            __m128i i;
+            if (t.uniform) {
+                i = _mm256_cvttpd_epi32(_mm256_mul_pd(x, n_minus_1));
+                i = _mm_min_epi32(i, max_segment);
+                __m256d a = _mm256_mask_i32gather_pd(zero_d, keys, i, all_d, 8);
+                __m256d b = _mm256_mask_i32gather_pd(zero_d, keys + 1, i, all_d, 8);
+                __m128i dec = narrow_mask(_mm256_cmp_pd(a, x, _CMP_GT_OQ));
+                __m128i inc = narrow_mask(_mm256_cmp_pd(b, x, _CMP_LE_OQ));
+                i = _mm_sub_epi32(_mm_add_epi32(i, dec), inc);
+                i = _mm_min_epi32(_mm_max_epi32(i, zero), max_segment);
+            } else {
+                i = zero;
+                for (size_t len = n - 1; len > 1; ) {
+                    size_t half = len / 2;
+                    __m128i h = _mm_set1_epi32(std::int32_t(half));
+                    __m256d k = _mm256_mask_i32gather_pd(zero_d, keys, _mm_add_epi32(i, h), all_d, 8);
+                    __m128i le = narrow_mask(_mm256_cmp_pd(k, x, _CMP_LE_OQ));
+                    i = _mm_add_epi32(i, _mm_and_si128(le, h));
+                    len -= half;
+                }
+            }
+
+            __m256d a = _mm256_mask_i32gather_pd(zero_d, keys, i, all_d, 8);
+            __m256d b = _mm256_mask_i32gather_pd(zero_d, keys + 1, i, all_d, 8);
+            __m256d mix = _mm256_div_pd(_mm256_sub_pd(x, a), _mm256_sub_pd(b, a));
+            __m256d w_d = _mm256_add_pd(_mm256_mul_pd(mix, w_one_d), w_half_d);
+            w_d = _mm256_min_pd(_mm256_max_pd(w_d, zero_d), w_one_d);
+            // truncate and convert to 64-bit integers, which is exact below
+            // 2^52 by adding 2^52 and taking the mantissa
+            w_d = _mm256_round_pd(w_d, _MM_FROUND_TO_ZERO | _MM_FROUND_NO_EXC);
+            __m256i w = _mm256_sub_epi64(_mm256_castpd_si256(_mm256_add_pd(w_d, magic)),
+                                         _mm256_castpd_si256(magic));
+            __m256i w_c = _mm256_sub_epi64(w_one, w);
+            __m256i w_hi = _mm256_srli_epi64(w, 32);
+            __m256i w_c_hi = _mm256_srli_epi64(w_c, 32);
+
+            // 64-bit products of the channels with the weights, from the 32
+            // x 32 bit products with their halves
+            alignas(16) std::int32_t v[N][4];
+            for (size_t k = 0; k < N; ++k) {
+                std::int32_t const * ch = t.channels + k * n;
+                __m256i ca = _mm256_cvtepi32_epi64(_mm_mask_i32gather_epi32(zero, ch, i, all, 4));
+                __m256i cb = _mm256_cvtepi32_epi64(_mm_mask_i32gather_epi32(zero, ch + 1, i, all, 4));
+                __m256i lo = _mm256_add_epi64(_mm256_mul_epu32(ca, w_c), _mm256_mul_epu32(cb, w));
+                __m256i hi = _mm256_add_epi64(_mm256_mul_epu32(ca, w_c_hi),
+                                              _mm256_mul_epu32(cb, w_hi));
+                __m256i c = _mm256_add_epi64(_mm256_add_epi64(lo, _mm256_slli_epi64(hi, 32)),
+                                             w_half);
+                c = _mm256_permutevar8x32_epi32(_mm256_srli_epi64(c, weight_bits), even);
+                _mm_store_si128(reinterpret_cast<__m128i*>(v[k]), _mm256_castsi256_si128(c));
+            }
+            for (size_t l = 0; l < 4; ++l) {
+                std::int32_t lane[N];
+                for (size_t k = 0; k < N; ++k)
+                    lane[k] = v[k][l];
+                out[j + l] = batch_table<Color>::traits::make(lane);
+            }
+        }
+        for (; j < count; ++j)
+            out[j] = t(in[j]);
+    }
+
+    __attribute__((target("sse2")))
+    inline __m128d load2 (double const * p) {
+        return _mm_loadu_pd(p);
+    }
+
+    __attribute__((target("sse2")))
+    inline __m128d load2 (float const * p) {
+        return _mm_cvtps_pd(_mm_castpd_ps(_mm_load_sd(reinterpret_cast<double const *>(p))));
+    }
+
+    // SSE2 lacks gathers and rounding: normalization and the interpolation
+    // weights are vectorized, the segment lookup and the channel
+    // interpolation are done per lane.
+    template <typename Color, typename Input>
+    __attribute__((target("sse2")))
+    void apply_sse2 (batch_table<Color> const& t,
+                     Input const * in, Color * out, size_t count)
+    {
+        double const * keys = t.keys;
+        const size_t n = t.n;
+        const __m128d lo = _mm_set1_pd(t.lo);
+        const __m128d width = _mm_set1_pd(t.width);
+        const __m128d k_first = _mm_set1_pd(keys[0]);
+        const __m128d k_last = _mm_set1_pd(keys[n-1]);
+        const __m128d zero_d = _mm_setzero_pd();
+        const __m128d w_one_d = _mm_set1_pd(double(std::uint64_t(1) << weight_bits));
+        const __m128d w_half_d = _mm_set1_pd(0.5);
+
+        size_t j = 0;
+        for (; j + 2 <= count; j += 2) {
+            __m128d x = load2(in + j);
+            x = _mm_div_pd(_mm_sub_pd(x, lo), width);
+            x = _mm_min_pd(_mm_max_pd(x, k_first), k_last);
+
+            alignas(16) double xs[2];
+            _mm_store_pd(xs, x);
+            size_t i0 = t.segment(xs[0]);
+            size_t i1 = t.segment(xs[1]);
+
+            __m128d a = _mm_setr_pd(keys[i0], keys[i1]);
+            __m128d b = _mm_setr_pd(keys[i0+1], keys[i1+1]);
+            __m128d mix = _mm_div_pd(_mm_sub_pd(x, a), _mm_sub_pd(b, a));
+            __m128d w_d = _mm_add_pd(_mm_mul_pd(mix, w_one_d), w_half_d);
+            w_d = _mm_min_pd(_mm_max_pd(w_d, zero_d), w_one_d);
+
+            alignas(16) double w[2];
+            _mm_store_pd(w, w_d);
+            out[j] = t.lerp(i0, std::uint64_t(w[0]));
+            out[j + 1] = t.lerp(i1, std::uint64_t(w[1]));
+        }
+        for (; j < count; ++j)
+            out[j] = t(in[j]);
+    }
+
+    inline bool cpu_has_avx2 () {
+        static const bool has = __builtin_cpu_supports("avx2");
+        return has;
+    }
+
+    inline bool cpu_has_sse2 () {
+        static const bool has = __builtin_cpu_supports("sse2");
+        return has;
+    }
+
+    inline bool cpu_has_ssse3 () {
+        static const bool has = __builtin_cpu_supports("ssse3");
+        return has;
+    }
+
+#endif // COLORMAP_X86_DISPATCH
+
+    // Pick the widest kernel supported by the CPU at runtime.
+    template <typename Color, typename Input>
+    void apply_batch (batch_table<Color> const& t,
+                      Input const * in, Color * out, size_t count)
+    {
+#ifdef COLORMAP_X86_DISPATCH
+        if (cpu_has_avx2())
+            return apply_avx2(t, in, out, count);
+        if (cpu_has_sse2())
+            return apply_sse2(t, in, out, count);
+#endif
+        for (size_t j = 0; j < count; ++j)
+            out[j] = t(in[j]);
+    }
+
+    // Colors with 8-bit RGB(A) channels and no padding, whose table entries
+    // can be fetched as one 32-bit word each by a gather instruction.
+    template <typename Color, typename = void>
+    struct gatherable : std::false_type {};
+
+    template <typename Color>
+    struct gatherable<Color, typename std::enable_if<channel_traits<Color>::batchable>::type>
+        : std::integral_constant<bool,
+            std::is_same<typename channel_traits<Color>::value_type, std::uint8_t>::value
+            && channel_traits<Color>::count >= 3
+            && sizeof(Color) == channel_traits<Color>::count
+            && std::is_trivially_copyable<Color>::value> {};
+
+    // The colors of a table as one 32-bit word each, for gathering. Empty if
+    // the colors are 32 bits wide already and can be gathered in place.
+    template <typename Color>
+    std::vector<std::uint32_t, aligned_allocator<std::uint32_t>>
+    pack_colors (Color const * colors, size_t n) {
+        std::vector<std::uint32_t, aligned_allocator<std::uint32_t>> packed;
+        if (sizeof(Color) == 4)
+            return packed;
+        packed.assign(n, 0);
+        for (size_t i = 0; i < n; ++i)
+            std::memcpy(&packed[i], &colors[i], sizeof(Color));
+        return packed;
+    }
+
+    // clamp `code` to [lo, hi] and return its offset from lo
+    template <typename Int>
+    inline size_t lut_index (Int code, std::int32_t lo, std::int32_t hi) {
+        std::int32_t c = code;
+        c = c > lo ? c : lo;
+        c = c < hi ? c : hi;
+        return size_t(c - lo);
+    }
+
+#ifdef COLORMAP_X86_DISPATCH
+
+    template <typename Int>
+    __attribute__((target("avx2")))
+    inline __m256i load_codes (Int const * p) {
+        if (sizeof(Int) == 4)
+            return _mm256_loadu_si256(reinterpret_cast<__m256i const *>(p));
+        if (sizeof(Int) == 1) {
+            __m128i v = _mm_loadl_epi64(reinterpret_cast<__m128i const *>(p));
+            return std::is_signed<Int>::value ? _mm256_cvtepi8_epi32(v)
+                                              : _mm256_cvtepu8_epi32(v);
+        }
+        __m128i v = _mm_loadu_si128(reinterpret_cast<__m128i const *>(p));
+        return std::is_signed<Int>::value ? _mm256_cvtepi16_epi32(v)
+                                          : _mm256_cvtepu16_epi32(v);
+    }
+
+    // Write eight gathered 32-bit pixels as packed 3- or 4-byte colors.
+    template <size_t N>
+    __attribute__((target("avx2")))
+    inline void store_gathered (unsigned char * d, __m256i px) {
+        if (N == 4) {
+            _mm256_storeu_si256(reinterpret_cast<__m256i *>(d), px);
+            return;
+        }
+        const __m256i drop_fourth = _mm256_setr_epi8(
+            0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1,
+            0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1);
+        px = _mm256_shuffle_epi8(px, drop_fourth);
+        __m128i first = _mm256_castsi256_si128(px);
+        __m128i second = _mm256_extracti128_si256(px, 1);
+        std::uint32_t tail;
+        _mm_storel_epi64(reinterpret_cast<__m128i *>(d), first);
+        tail = std::uint32_t(_mm_extract_epi32(first, 2));
+        std::memcpy(d + 8, &tail, 4);
+        _mm_storel_epi64(reinterpret_cast<__m128i *>(d + 12), second);
+        tail = std::uint32_t(_mm_extract_epi32(second, 2));
+        std::memcpy(d + 20, &tail, 4);
+    }
+
+    // Look up eight codes at once with a 32-bit gather from the packed table
+    // and scatter the three or four bytes of each pixel to the output.
+    template <typename Color, typename Int>
+    __attribute__((target("avx2")))
+    void gather_avx2 (std::uint32_t const * packed, std::int32_t lo, std::int32_t hi,
+                      Int const * in, Color * out, size_t count)
+    {
+        constexpr size_t N = channel_traits<Color>::count;
+        const __m256i lo_v = _mm256_set1_epi32(lo);
+        const __m256i hi_v = _mm256_set1_epi32(hi);
+        unsigned char * dst = reinterpret_cast<unsigned char *>(out);
+
+        size_t j = 0;
+        for (; j + 8 <= count; j += 8) {
+            __m256i c = load_codes(in + j);
+            c = _mm256_min_epi32(_mm256_max_epi32(c, lo_v), hi_v);
+            c = _mm256_sub_epi32(c, lo_v);
+            __m256i px = _mm256_i32gather_epi32(reinterpret_cast<int const *>(packed), c, 4);
+            store_gathered<N>(dst + N * j, px);
+        }
+        for (; j < count; ++j)
+            std::memcpy(dst + N * j, packed + lut_index(in[j], lo, hi), N);
+    }
+
+    // Resolve four labels to category indices in [0, n), either wrapping
+    // around or clamping. Done in double precision, which represents every
+    // 32-bit label and product of quotient and n exactly.
+    __attribute__((target("avx2")))
+    inline __m128i category_index4 (__m256d x, __m256d n, __m256d inv_n, bool wrap) {
+        const __m256d zero = _mm256_setzero_pd();
+        __m256d r;
+        if (wrap) {
+            __m256d q = _mm256_floor_pd(_mm256_mul_pd(x, inv_n));
+            r = _mm256_sub_pd(x, _mm256_mul_pd(q, n));
+            r = _mm256_add_pd(r, _mm256_and_pd(_mm256_cmp_pd(r, zero, _CMP_LT_OQ), n));
+            r = _mm256_sub_pd(r, _mm256_and_pd(_mm256_cmp_pd(r, n, _CMP_GE_OQ), n));
+        } else {
+            r = _mm256_max_pd(x, zero);
+            r = _mm256_min_pd(r, _mm256_sub_pd(n, _mm256_set1_pd(1.)));
+        }
+        return _mm256_cvttpd_epi32(r);
+    }
+
+    template <typename Int>
+    __attribute__((target("avx2")))
+    inline __m256i category_index8 (Int const * p, __m256d n, __m256d inv_n, bool wrap) {
+        __m256i c = load_codes(p);
+        __m256d x[2] = {_mm256_cvtepi32_pd(_mm256_castsi256_si128(c)),
+                        _mm256_cvtepi32_pd(_mm256_extracti128_si256(c, 1))};
+        if (sizeof(Int) == 4 && std::is_unsigned<Int>::value) {
+            const __m256d two32 = _mm256_set1_pd(4294967296.);
+            for (size_t h = 0; h < 2; ++h)
+                x[h] = _mm256_add_pd(x[h], _mm256_and_pd(
+                    _mm256_cmp_pd(x[h], _mm256_setzero_pd(), _CMP_LT_OQ), two32));
+        }
+        return _mm256_setr_m128i(category_index4(x[0], n, inv_n, wrap),
+                                 category_index4(x[1], n, inv_n, wrap));
+    }
+
+    template <typename Color, typename Int>
+    __attribute__((target("avx2")))
+    size_t categorical_avx2 (std::uint32_t const * packed, size_t size, bool wrap,
+                             Int const * in, Color * out, size_t count)
+    {
+        constexpr size_t N = channel_traits<Color>::count;
+        const __m256d n = _mm256_set1_pd(double(size));
+        const __m256d inv_n = _mm256_set1_pd(1. / size);
+        unsigned char * dst = reinterpret_cast<unsigned char *>(out);
+        size_t j = 0;
+        for (; j + 8 <= count; j += 8) {
+            __m256i idx = category_index8(in + j, n, inv_n, wrap);
+            __m256i px = _mm256_i32gather_epi32(reinterpret_cast<int const *>(packed), idx, 4);
+            store_gathered<N>(dst + N * j, px);
+        }
+        return j;
+    }
+
+    template <typename Int>
+    __attribute__((target("avx2")))
+    size_t category_indices_avx2 (size_t size, bool wrap,
+                                  Int const * in, std::uint8_t * out, size_t count)
+    {
+        const __m256d n = _mm256_set1_pd(double(size));
+        const __m256d inv_n = _mm256_set1_pd(1. / size);
+        const __m128i narrow = _mm_setr_epi8(0, 4, 8, 12, -1, -1, -1, -1,
+                                             -1, -1, -1, -1, -1, -1, -1, -1);
+        size_t j = 0;
+        for (; j + 8 <= count; j += 8) {
+            __m256i idx = category_index8(in + j, n, inv_n, wrap);
+            __m128i lo = _mm_shuffle_epi8(_mm256_castsi256_si128(idx), narrow);
+            __m128i hi = _mm_shuffle_epi8(_mm256_extracti128_si256(idx, 1), narrow);
+            _mm_storel_epi64(reinterpret_cast<__m128i *>(out + j),
+                             _mm_unpacklo_epi32(lo, hi));
+        }
+        return j;
+    }
+
+#endif // COLORMAP_X86_DISPATCH
+
+    template <typename Color, typename Int>
+    void gather_batch (Color const * table, std::uint32_t const *,
+                       std::int32_t lo, std::int32_t hi,
+                       Int const * in, Color * out, size_t count, std::false_type)
+    {
+        for (size_t j = 0; j < count; ++j)
+            out[j] = table[lut_index(in[j], lo, hi)];
+    }
+
+    template <typename Color, typename Int>
+    void gather_batch (Color const * table, std::uint32_t const * packed,
+                       std::int32_t lo, std::int32_t hi,
+                       Int const * in, Color * out, size_t count, std::true_type)
+    {
+#ifdef COLORMAP_X86_DISPATCH
+        if (cpu_has_avx2())
+            return gather_avx2(packed, lo, hi, in, out, count);
+#endif
+        gather_batch(table, packed, lo, hi, in, out, count, std::false_type{});
+    }
+
+    // Category of `label` among `size` categories, wrapping around or
+    // clamping labels outside [0, size). Unsigned labels are handled in
+    // unsigned arithmetic so that ones above INT64_MAX keep their order.
+    template <typename Int>
+    inline size_t category_index (Int label, size_t size, bool wrap, std::true_type) {
+        std::int64_t x = label;
+        std::int64_t n = size;
+        if (wrap) {
+            std::int64_t r = x % n;
+            return size_t(r < 0 ? r + n : r);
+        }
+        x = x > 0 ? x : 0;
+        return size_t(x < n - 1 ? x : n - 1);
+    }
+
+    template <typename Int>
+    inline size_t category_index (Int label, size_t size, bool wrap, std::false_type) {
+        std::uint64_t x = label;
+        if (wrap)
+            return size_t(x % size);
+        return size_t(x < size - 1 ? x : size - 1);
+    }
+
+    template <typename Int>
+    inline size_t category_index (Int label, size_t size, bool wrap) {
+        if (size == 0)
+            throw std::out_of_range("no categories to choose from");
+        return category_index(label, size, wrap, std::is_signed<Int>{});
+    }
+
+    template <typename Color, typename Int>
+    void categorical_batch (Color const * table, std::uint32_t const *, size_t size,
+                            bool wrap, Int const * in, Color * out, size_t count,
+                            std::false_type)
+    {
+        for (size_t j = 0; j < count; ++j)
+            out[j] = table[category_index(in[j], size, wrap)];
+    }
+
+    template <typename Color, typename Int>
+    void categorical_batch (Color const * table, std::uint32_t const * packed, size_t size,
+                            bool wrap, Int const * in, Color * out, size_t count,
+                            std::true_type)
+    {
+        size_t j = 0;
+#ifdef COLORMAP_X86_DISPATCH
+        if (cpu_has_avx2())
+            j = categorical_avx2(packed, size, wrap, in, out, count);
+#endif
+        categorical_batch(table, packed, size, wrap, in + j, out + j, count - j,
+                          std::false_type{});
+    }
+
+    template <typename Int>
+    void category_indices (size_t size, bool wrap, Int const * in,
+                           std::uint8_t * out, size_t count)
+    {
+        size_t j = 0;
+#ifdef COLORMAP_X86_DISPATCH
+        if (sizeof(Int) <= 4 && cpu_has_avx2())
+            j = category_indices_avx2(size, wrap, in, out, count);
+#endif
+        for (; j < count; ++j)
+            out[j] = std::uint8_t(category_index(in[j], size, wrap));
+    }
+
+}
+}
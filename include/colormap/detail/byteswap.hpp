@@ -0,0 +1,89 @@
+// colormap -- color palettes, map iterators, grids, and PPM export
+// Copyright (C) 2018-2019  Jonas Greitemann
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#include <colormap/detail/batch.hpp>
+
+
+namespace colormap {
+namespace detail {
+
+    // Byte order of the host. Binary PNM and PAM files hold multi-byte
+    // samples most significant byte first.
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    constexpr bool native_big_endian = true;
+#else
+    constexpr bool native_big_endian = false;
+#endif
+
+    inline void byteswap16_scalar (char * p, size_t n) {
+        for (size_t i = 0; i < n; ++i, p += 2) {
+            std::uint16_t v;
+            std::memcpy(&v, p, 2);
+            v = std::uint16_t(v << 8 | v >> 8);
+            std::memcpy(p, &v, 2);
+        }
+    }
+
+#ifdef COLORMAP_X86_DISPATCH
+
+    // Swap the bytes of n 16-bit values in place, 32 bytes per shuffle.
+    __attribute__((target("avx2")))
+    inline void byteswap16_avx2 (char * p, size_t n) {
+        const __m256i swap = _mm256_setr_epi8(
+            1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14,
+            1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14);
+        size_t i = 0;
+        for (; i + 16 <= n; i += 16, p += 32) {
+            __m256i v = _mm256_loadu_si256(reinterpret_cast<__m256i const *>(p));
+            _mm256_storeu_si256(reinterpret_cast<__m256i *>(p), _mm256_shuffle_epi8(v, swap));
+        }
+        byteswap16_scalar(p, n - i);
+    }
+
+    __attribute__((target("ssse3")))
+    inline void byteswap16_ssse3 (char * p, size_t n) {
+        const __m128i swap = _mm_setr_epi8(1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14);
+        size_t i = 0;
+        for (; i + 8 <= n; i += 8, p += 16) {
+            __m128i v = _mm_loadu_si128(reinterpret_cast<__m128i const *>(p));
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(p), _mm_shuffle_epi8(v, swap));
+        }
+        byteswap16_scalar(p, n - i);
+    }
+
+#endif // COLORMAP_X86_DISPATCH
+
+    // Swap the bytes of the n 16-bit values at p, picking the widest
+    // kernel supported by the CPU at runtime.
+    inline void byteswap16 (char * p, size_t n) {
+#ifdef COLORMAP_X86_DISPATCH
+        if (cpu_has_avx2())
+            return byteswap16_avx2(p, n);
+        if (cpu_has_ssse3())
+            return byteswap16_ssse3(p, n);
+#endif
+        byteswap16_scalar(p, n);
+    }
+
+}
+}
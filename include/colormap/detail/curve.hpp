@@ -0,0 +1,323 @@
+// colormap -- color palettes, map iterators, grids, and PPM export
+// Copyright (C) 2018-2019  Jonas Greitemann
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+
+#if !defined(COLORMAP_NO_SIMD) && defined(__BMI2__) && defined(__x86_64__)
+#define COLORMAP_HAVE_BMI2 1
+#include <immintrin.h>
+#endif
+
+
+namespace colormap {
+namespace detail {
+
+    // Bit interleaving for Morton codes: bit i of a coordinate goes to bit
+    // n*i of the code. With BMI2 (i.e. when compiling with -mbmi2 or
+    // -march=native on a CPU which has it) this is a single pdep/pext;
+    // the decision is made at compile time since it sits in the innermost
+    // loop of the grid traversal.
+    template <size_t n>
+    struct bit_interleave;
+
+    template <>
+    struct bit_interleave<2> {
+        static constexpr unsigned max_bits = 31;
+
+        static std::uint64_t spread (std::uint64_t x) {
+#ifdef COLORMAP_HAVE_BMI2
+            return _pdep_u64(x, 0x5555555555555555ull);
+#else
+            x &= 0xffffffffull;
+            x = (x | x << 16) & 0x0000ffff0000ffffull;
+            x = (x | x << 8) & 0x00ff00ff00ff00ffull;
+            x = (x | x << 4) & 0x0f0f0f0f0f0f0f0full;
+            x = (x | x << 2) & 0x3333333333333333ull;
+            x = (x | x << 1) & 0x5555555555555555ull;
+            return x;
+#endif
+        }
+
+        static std::uint64_t compact (std::uint64_t x) {
+#ifdef COLORMAP_HAVE_BMI2
+            return _pext_u64(x, 0x5555555555555555ull);
+#else
+            x &= 0x5555555555555555ull;
+            x = (x | x >> 1) & 0x3333333333333333ull;
+            x = (x | x >> 2) & 0x0f0f0f0f0f0f0f0full;
+            x = (x | x >> 4) & 0x00ff00ff00ff00ffull;
+            x = (x | x >> 8) & 0x0000ffff0000ffffull;
+            x = (x | x >> 16) & 0x00000000ffffffffull;
+            return x;
+#endif
+        }
+    };
+
+    template <>
+    struct bit_interleave<3> {
+        static constexpr unsigned max_bits = 21;
+
+        static std::uint64_t spread (std::uint64_t x) {
+#ifdef COLORMAP_HAVE_BMI2
+            return _pdep_u64(x, 0x1249249249249249ull);
+#else
+            x &= 0x1fffffull;
+            x = (x | x << 32) & 0x001f00000000ffffull;
+            x = (x | x << 16) & 0x001f0000ff0000ffull;
+            x = (x | x << 8) & 0x100f00f00f00f00full;
+            x = (x | x << 4) & 0x10c30c30c30c30c3ull;
+            x = (x | x << 2) & 0x1249249249249249ull;
+            return x;
+#endif
+        }
+
+        static std::uint64_t compact (std::uint64_t x) {
+#ifdef COLORMAP_HAVE_BMI2
+            return _pext_u64(x, 0x1249249249249249ull);
+#else
+            x &= 0x1249249249249249ull;
+            x = (x ^ (x >> 2)) & 0x10c30c30c30c30c3ull;
+            x = (x ^ (x >> 4)) & 0x100f00f00f00f00full;
+            x = (x ^ (x >> 8)) & 0x001f0000ff0000ffull;
+            x = (x ^ (x >> 16)) & 0x001f00000000ffffull;
+            x = (x ^ (x >> 32)) & 0x00000000001fffffull;
+            return x;
+#endif
+        }
+    };
+
+    template <size_t n>
+    using curve_point = std::array<std::uint32_t, n>;
+
+    // Z-order curve; the first dimension varies fastest.
+    template <size_t n>
+    struct morton_curve {
+        static std::uint64_t encode (curve_point<n> const& x, unsigned) {
+            std::uint64_t code = 0;
+            for (size_t k = 0; k < n; ++k)
+                code |= bit_interleave<n>::spread(x[k]) << k;
+            return code;
+        }
+
+        static curve_point<n> decode (std::uint64_t code, unsigned) {
+            curve_point<n> x;
+            for (size_t k = 0; k < n; ++k)
+                x[k] = std::uint32_t(bit_interleave<n>::compact(code >> k));
+            return x;
+        }
+    };
+
+    // Hilbert curve through the cube of side 2^bits, after J. Skilling,
+    // "Programming the Hilbert curve", AIP Conf. Proc. 707, 381 (2004):
+    // the coordinates are transformed in place into the "transposed" form
+    // of the Hilbert index, whose bits are then interleaved as for Morton
+    // codes.
+    template <size_t n>
+    struct hilbert_curve {
+        static std::uint64_t encode (curve_point<n> x, unsigned bits) {
+            const std::uint32_t m = std::uint32_t(1) << (bits - 1);
+            for (std::uint32_t q = m; q > 1; q >>= 1)
+                for (size_t k = 0; k < n; ++k)
+                    untangle(x[0], x[k], q);
+            for (size_t k = 1; k < n; ++k)
+                x[k] ^= x[k-1];
+            std::uint32_t t = 0;
+            for (std::uint32_t q = m; q > 1; q >>= 1)
+                if (x[n-1] & q)
+                    t ^= q - 1;
+            std::uint64_t code = 0;
+            for (size_t k = 0; k < n; ++k)
+                code |= bit_interleave<n>::spread(x[k] ^ t) << (n - 1 - k);
+            return code;
+        }
+
+        static curve_point<n> decode (std::uint64_t code, unsigned bits) {
+            curve_point<n> x;
+            for (size_t k = 0; k < n; ++k)
+                x[k] = std::uint32_t(bit_interleave<n>::compact(code >> (n - 1 - k)));
+            std::uint32_t t = x[n-1] >> 1;
+            for (size_t k = n - 1; k > 0; --k)
+                x[k] ^= x[k-1];
+            x[0] ^= t;
+            const std::uint32_t end = std::uint32_t(2) << (bits - 1);
+            for (std::uint32_t q = 2; q != end; q <<= 1)
+                for (size_t k = n; k-- > 0; )
+                    untangle(x[0], x[k], q);
+            return x;
+        }
+
+    private:
+        // If bit q of xk is set, invert the lower bits of x0, otherwise
+        // exchange them with those of xk.
+        static void untangle (std::uint32_t & x0, std::uint32_t & xk, std::uint32_t q) {
+            const std::uint32_t p = q - 1;
+            if (xk & q) {
+                x0 ^= p;
+            } else {
+                std::uint32_t t = (x0 ^ xk) & p;
+                x0 ^= t;
+                xk ^= t;
+            }
+        }
+    };
+
+    // A box of the given shape in the corner of the smallest enclosing cube
+    // of side 2^bits, traversed along a space-filling curve which skips the
+    // points outside the box. Both curves fill aligned sub-cubes one at a
+    // time (codes [c, c + 2^(n*l)) with c a multiple of 2^(n*l) cover a cube
+    // of side 2^l), so the box is searched and counted block by block.
+    template <typename Curve, size_t n>
+    struct curve_box {
+        curve_box () : shape{}, bits(1) {}
+
+        template <typename Shape>
+        explicit curve_box (Shape const& s) : bits(1) {
+            for (size_t k = 0; k < n; ++k) {
+                if (s[k] > (size_t(1) << bit_interleave<n>::max_bits))
+                    throw std::runtime_error("grid too large for space-filling curve");
+                shape[k] = std::uint32_t(s[k]);
+                while ((size_t(1) << bits) < s[k])
+                    ++bits;
+            }
+        }
+
+        // one past the last code of the enclosing cube
+        std::uint64_t end () const {
+            return std::uint64_t(1) << (n * bits);
+        }
+
+        std::uint64_t size () const {
+            std::uint64_t prod = 1;
+            for (size_t k = 0; k < n; ++k)
+                prod *= shape[k];
+            return prod;
+        }
+
+        bool contains (curve_point<n> const& x) const {
+            for (size_t k = 0; k < n; ++k)
+                if (x[k] >= shape[k])
+                    return false;
+            return true;
+        }
+
+        std::uint64_t encode (curve_point<n> const& x) const {
+            return Curve::encode(x, bits);
+        }
+
+        curve_point<n> decode (std::uint64_t code) const {
+            return Curve::decode(code, bits);
+        }
+
+        // number of points in the box among the codes [c, c + 2^(n*l))
+        std::uint64_t block_count (std::uint64_t c, unsigned l) const {
+            const curve_point<n> x = decode(c);
+            const std::uint32_t side = std::uint32_t(1) << l;
+            std::uint64_t prod = 1;
+            for (size_t k = 0; k < n; ++k) {
+                std::uint32_t lo = x[k] & ~(side - 1);
+                if (lo >= shape[k])
+                    return 0;
+                prod *= std::min(side, shape[k] - lo);
+            }
+            return prod;
+        }
+
+        // number of points in the box with a code less than c, i.e. the
+        // position of the point at code c in the traversal
+        std::uint64_t rank (std::uint64_t c) const {
+            if (c >= end())
+                return size();
+            std::uint64_t r = 0;
+            for (unsigned l = bits; l-- > 0; ) {
+                const std::uint64_t child = std::uint64_t(1) << (n * l);
+                const std::uint64_t parent = c & ~((child << n) - 1);
+                const std::uint64_t digit = (c - parent) >> (n * l);
+                for (std::uint64_t j = 0; j < digit; ++j)
+                    r += block_count(parent + j * child, l);
+            }
+            return r;
+        }
+
+        // code of the r-th point in the box
+        std::uint64_t select (std::uint64_t r) const {
+            if (r >= size())
+                return end();
+            std::uint64_t c = 0;
+            for (unsigned l = bits; l-- > 0; ) {
+                const std::uint64_t child = std::uint64_t(1) << (n * l);
+                for (;; c += child) {
+                    std::uint64_t count = block_count(c, l);
+                    if (r < count)
+                        break;
+                    r -= count;
+                }
+            }
+            return c;
+        }
+
+        // Smallest code >= c of a point in the box (or `end()`); its
+        // coordinates are stored in x. Blocks outside the box are skipped
+        // as a whole.
+        std::uint64_t next (std::uint64_t c, curve_point<n> & x) const {
+            unsigned l = 0;
+            while (c < end()) {
+                if (l == 0) {
+                    x = decode(c);
+                    if (contains(x))
+                        return c;
+                } else if (block_count(c, l) > 0) {
+                    --l;
+                    continue;
+                }
+                c += std::uint64_t(1) << (n * l);
+                while (l < bits && (c & ((std::uint64_t(1) << (n * (l + 1))) - 1)) == 0)
+                    ++l;
+            }
+            return end();
+        }
+
+        // Largest code <= c of a point in the box, which has to exist.
+        std::uint64_t prev (std::uint64_t c, curve_point<n> & x) const {
+            unsigned l = 0;
+            for (;;) {
+                const std::uint64_t first = c + 1 - (std::uint64_t(1) << (n * l));
+                if (l == 0) {
+                    x = decode(c);
+                    if (contains(x))
+                        return c;
+                } else if (block_count(first, l) > 0) {
+                    --l;
+                    continue;
+                }
+                c = first - 1;
+                while (l < bits && ((c + 1) & ((std::uint64_t(1) << (n * (l + 1))) - 1)) == 0)
+                    ++l;
+            }
+        }
+
+        curve_point<n> shape;
+        unsigned bits;
+    };
+
+}
+}
@@ -0,0 +1,306 @@
+// colormap -- color palettes, map iterators, grids, and PPM export
+// Copyright (C) 2018-2019  Jonas Greitemann
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <stdexcept>
+#include <vector>
+
+#ifdef COLORMAP_WITH_ZLIB
+#include <zlib.h>
+#endif
+
+
+namespace colormap {
+namespace detail {
+
+    // Checksums and raw DEFLATE (RFC 1951) streams for PNG output. Each
+    // call to one of the `deflate_*` functions compresses one segment of a
+    // larger stream: segments end on a byte boundary and only the final one
+    // sets the BFINAL bit (like zlib's Z_SYNC_FLUSH), so that segments which
+    // are compressed independently can simply be concatenated.
+
+    inline std::uint32_t crc32_update (std::uint32_t crc, unsigned char const * p, size_t n) {
+#ifdef COLORMAP_WITH_ZLIB
+        while (n > 0) {
+            uInt chunk = uInt(std::min<size_t>(n, std::numeric_limits<uInt>::max()));
+            crc = std::uint32_t(::crc32(crc, p, chunk));
+            p += chunk;
+            n -= chunk;
+        }
+        return crc;
+#else
+        static const std::array<std::uint32_t, 256> table = [] {
+            std::array<std::uint32_t, 256> t;
+            for (std::uint32_t i = 0; i < 256; ++i) {
+                std::uint32_t c = i;
+                for (int k = 0; k < 8; ++k)
+                    c = c & 1 ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+                t[i] = c;
+            }
+            return t;
+        }();
+        crc = ~crc;
+        for (size_t i = 0; i < n; ++i)
+            crc = table[(crc ^ p[i]) & 0xFF] ^ (crc >> 8);
+        return ~crc;
+#endif
+    }
+
+    inline std::uint32_t adler32_update (std::uint32_t adler, unsigned char const * p, size_t n) {
+        constexpr std::uint32_t base = 65521;
+        // largest n such that 255 n (n+1) / 2 + (n+1) (base-1) fits 32 bits
+        constexpr size_t nmax = 5552;
+        std::uint32_t a = adler & 0xFFFF;
+        std::uint32_t b = adler >> 16;
+        while (n > 0) {
+            size_t chunk = std::min(n, nmax);
+            for (size_t i = 0; i < chunk; ++i) {
+                a += p[i];
+                b += a;
+            }
+            a %= base;
+            b %= base;
+            p += chunk;
+            n -= chunk;
+        }
+        return (b << 16) | a;
+    }
+
+    // Appends bits to a byte vector, least significant bit first.
+    struct bit_writer {
+        explicit bit_writer (std::vector<unsigned char> & out) : out(out) {}
+
+        void put (std::uint32_t value, unsigned n) {
+            bits |= std::uint64_t(value) << count;
+            count += n;
+            while (count >= 8) {
+                out.push_back((unsigned char)(bits));
+                bits >>= 8;
+                count -= 8;
+            }
+        }
+
+        // Huffman codes are defined most significant bit first
+        void put_code (std::uint32_t code, unsigned n) {
+            std::uint32_t reversed = 0;
+            for (unsigned i = 0; i < n; ++i)
+                reversed |= ((code >> i) & 1) << (n - 1 - i);
+            put(reversed, n);
+        }
+
+        void align () {
+            if (count > 0)
+                put(0, 8 - count);
+        }
+
+    private:
+        std::vector<unsigned char> & out;
+        std::uint64_t bits = 0;
+        unsigned count = 0;
+    };
+
+    // end a non-final segment on a byte boundary
+    inline void sync_flush (bit_writer & bw, std::vector<unsigned char> & out) {
+        bw.put(0, 3);
+        bw.align();
+        out.insert(out.end(), {0x00, 0x00, 0xFF, 0xFF});
+    }
+
+    inline void deflate_stored (unsigned char const * data, size_t size, bool final,
+                                std::vector<unsigned char> & out)
+    {
+        do {
+            size_t len = std::min<size_t>(size, 0xFFFF);
+            bool last = final && len == size;
+            out.push_back(last ? 1 : 0);
+            out.push_back((unsigned char)(len));
+            out.push_back((unsigned char)(len >> 8));
+            out.push_back((unsigned char)(~len));
+            out.push_back((unsigned char)(~len >> 8));
+            out.insert(out.end(), data, data + len);
+            data += len;
+            size -= len;
+        } while (size > 0);
+    }
+
+    struct fixed_huffman {
+        static void literal (bit_writer & bw, unsigned sym) {
+            if (sym < 144)
+                bw.put_code(0x30 + sym, 8);
+            else if (sym < 256)
+                bw.put_code(0x190 + sym - 144, 9);
+            else if (sym < 280)
+                bw.put_code(sym - 256, 7);
+            else
+                bw.put_code(0xC0 + sym - 280, 8);
+        }
+
+        static void match (bit_writer & bw, unsigned len, unsigned dist) {
+            static constexpr unsigned short len_base[29] = {
+                3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+                35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258};
+            static constexpr unsigned char len_extra[29] = {
+                0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+                3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0};
+            static constexpr unsigned short dist_base[30] = {
+                1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+                257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145,
+                8193, 12289, 16385, 24577};
+            static constexpr unsigned char dist_extra[30] = {
+                0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+                7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13};
+            unsigned l = unsigned(std::upper_bound(len_base, len_base + 29, len) - len_base) - 1;
+            literal(bw, 257 + l);
+            bw.put(len - len_base[l], len_extra[l]);
+            unsigned d = unsigned(std::upper_bound(dist_base, dist_base + 30, dist) - dist_base) - 1;
+            bw.put_code(d, 5);
+            bw.put(dist - dist_base[d], dist_extra[d]);
+        }
+    };
+
+    // Compress data[start, size) as fixed-Huffman blocks, with greedy LZ77
+    // matching over hash chains. data[0, start) serves as history which
+    // matches may refer back to.
+    inline void deflate_fixed (unsigned char const * data, size_t start, size_t size,
+                               bool final, std::vector<unsigned char> & out)
+    {
+        constexpr size_t window = 32768;
+        constexpr unsigned min_match = 3;
+        constexpr unsigned max_match = 258;
+        constexpr unsigned max_chain = 16;
+        constexpr unsigned hash_bits = 15;
+
+        std::vector<std::int32_t> head(size_t(1) << hash_bits, -1);
+        std::vector<std::int32_t> prev(size, -1);
+        auto hash = [data] (size_t i) {
+            std::uint32_t v = data[i] | (data[i+1] << 8) | (data[i+2] << 16);
+            return (v * 2654435761u) >> (32 - hash_bits);
+        };
+        auto insert = [&] (size_t i) {
+            if (i + min_match <= size) {
+                auto h = hash(i);
+                prev[i] = head[h];
+                head[h] = std::int32_t(i);
+            }
+        };
+        for (size_t i = start > window ? start - window : 0; i < start; ++i)
+            insert(i);
+
+        bit_writer bw(out);
+        bw.put(final ? 1 : 0, 1);
+        bw.put(1, 2);
+        for (size_t i = start; i < size; ) {
+            unsigned best_len = 0;
+            size_t best_dist = 0;
+            if (i + min_match <= size) {
+                unsigned limit = unsigned(std::min<size_t>(max_match, size - i));
+                std::int32_t cand = head[hash(i)];
+                for (unsigned chain = 0; cand >= 0 && chain < max_chain; ++chain) {
+                    size_t dist = i - size_t(cand);
+                    if (dist > window)
+                        break;
+                    unsigned len = 0;
+                    while (len < limit && data[cand + len] == data[i + len])
+                        ++len;
+                    if (len > best_len) {
+                        best_len = len;
+                        best_dist = dist;
+                        if (len == limit)
+                            break;
+                    }
+                    cand = prev[cand];
+                }
+            }
+            if (best_len >= min_match) {
+                fixed_huffman::match(bw, best_len, unsigned(best_dist));
+                for (size_t end = i + best_len; i < end; ++i)
+                    insert(i);
+            } else {
+                fixed_huffman::literal(bw, data[i]);
+                insert(i++);
+            }
+        }
+        fixed_huffman::literal(bw, 256);
+        if (final)
+            bw.align();
+        else
+            sync_flush(bw, out);
+    }
+
+#ifdef COLORMAP_WITH_ZLIB
+
+    // Compress data[start, size) with zlib, priming its window with the
+    // history data[0, start). deflate is called until it has consumed all
+    // input and, with Z_SYNC_FLUSH, has room left over after the flush
+    // (or, with Z_FINISH, has ended the stream), growing `out` as needed.
+    inline void deflate_zlib (unsigned char const * data, size_t start, size_t size,
+                              bool final, int level, std::vector<unsigned char> & out)
+    {
+        z_stream zs {};
+        if (deflateInit2(&zs, level, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+            throw std::runtime_error("deflateInit2 failed");
+        size_t history = std::min<size_t>(start, 32768);
+        if (history > 0
+            && deflateSetDictionary(&zs, data + start - history, uInt(history)) != Z_OK)
+        {
+            deflateEnd(&zs);
+            throw std::runtime_error("deflateSetDictionary failed");
+        }
+        const size_t max_chunk = std::numeric_limits<uInt>::max();
+        const int flush = final ? Z_FINISH : Z_SYNC_FLUSH;
+        unsigned char const * in = data + start;
+        size_t pending = size - start;
+        size_t produced = out.size();
+        out.resize(produced + deflateBound(&zs, uLong(std::min(pending, max_chunk))) + 16);
+        int ret;
+        bool done = false;
+        do {
+            if (zs.avail_in == 0 && pending > 0) {
+                uInt chunk = uInt(std::min(pending, max_chunk));
+                zs.next_in = const_cast<unsigned char *>(in);
+                zs.avail_in = chunk;
+                in += chunk;
+                pending -= chunk;
+            }
+            if (produced == out.size())
+                out.resize(produced + produced / 2 + 4096);
+            uInt room = uInt(std::min(out.size() - produced, max_chunk));
+            zs.next_out = out.data() + produced;
+            zs.avail_out = room;
+            ret = deflate(&zs, pending == 0 ? flush : Z_NO_FLUSH);
+            produced += room - zs.avail_out;
+            if (ret != Z_OK && ret != Z_STREAM_END && ret != Z_BUF_ERROR)
+                break;
+            done = final ? ret == Z_STREAM_END
+                         : pending == 0 && zs.avail_in == 0 && zs.avail_out != 0;
+        } while (!done);
+        out.resize(produced);
+        deflateEnd(&zs);
+        if (!done)
+            throw std::runtime_error("deflate failed");
+    }
+
+#endif // COLORMAP_WITH_ZLIB
+
+}
+}
@@ -0,0 +1,124 @@
+// colormap -- color palettes, map iterators, grids, and PPM export
+// Copyright (C) 2018-2019  Jonas Greitemann
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+#pragma once
+
+#ifdef __linux__
+#define COLORMAP_HAVE_DIRECT_IO 1
+
+#include <atomic>
+#include <cerrno>
+#include <cstddef>
+#include <string>
+#include <system_error>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+
+namespace colormap {
+namespace detail {
+
+    // The constants of `direct_file` live in a class template, so that
+    // their definitions can go into the header.
+    template <typename = void>
+    struct direct_file_constants {
+        static constexpr size_t alignment = 4096;
+    };
+
+    template <typename T>
+    constexpr size_t direct_file_constants<T>::alignment;
+
+    // A file written with O_DIRECT, bypassing the page cache. Offsets,
+    // lengths, and buffer addresses passed to `write_at` need to be
+    // multiples of `alignment`; the file is truncated to its actual size by
+    // `finish`. If the file system does not support direct I/O, the file is
+    // written through the page cache instead, and its pages are written
+    // back and dropped from the cache by `finish`.
+    struct direct_file : direct_file_constants<> {
+        explicit direct_file (std::string const& path) : path(path) {
+            fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_DIRECT, 0644);
+            if (fd < 0 && errno == EINVAL) {
+                direct = false;
+                fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+            }
+            if (fd < 0)
+                fail("cannot open ");
+        }
+
+        direct_file (direct_file const&) = delete;
+        direct_file & operator= (direct_file const&) = delete;
+
+        ~direct_file () {
+            if (fd >= 0)
+                ::close(fd);
+        }
+
+        void write_at (char const * data, size_t size, size_t offset) {
+            while (size > 0) {
+                ssize_t n = ::pwrite(fd, data, size, off_t(offset));
+                if (n < 0 && errno == EINTR)
+                    continue;
+                if (n < 0 && errno == EINVAL && direct) {
+                    // some file systems accept O_DIRECT but reject the I/O
+                    direct = false;
+                    if (::fcntl(fd, F_SETFL, ::fcntl(fd, F_GETFL) & ~O_DIRECT) != 0)
+                        fail("cannot disable direct I/O for ");
+                    continue;
+                }
+                if (n <= 0)
+                    fail("cannot write ");
+                data += n;
+                size -= n;
+                offset += n;
+            }
+        }
+
+        void finish (size_t size) {
+            if (::ftruncate(fd, off_t(size)) != 0)
+                fail("cannot resize ");
+            if (!direct) {
+                ::sync_file_range(fd, 0, 0, SYNC_FILE_RANGE_WAIT_BEFORE
+                                  | SYNC_FILE_RANGE_WRITE | SYNC_FILE_RANGE_WAIT_AFTER);
+                ::posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+            }
+            if (::close(fd) != 0) {
+                fd = -1;
+                fail("cannot close ");
+            }
+            fd = -1;
+        }
+
+        bool is_direct () const {
+            return direct;
+        }
+
+    private:
+        [[noreturn]] void fail (std::string const& what) {
+            throw std::system_error(errno, std::generic_category(), what + path);
+        }
+
+        std::string path;
+        int fd = -1;
+        std::atomic<bool> direct {true};
+    };
+
+}
+}
+
+#endif // __linux__
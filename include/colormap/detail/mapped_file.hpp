@@ -0,0 +1,121 @@
+// colormap -- color palettes, map iterators, grids, and PPM export
+// Copyright (C) 2018-2019  Jonas Greitemann
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+#pragma once
+
+#if defined(__unix__) || defined(__APPLE__)
+#define COLORMAP_HAVE_MMAP 1
+
+#include <cerrno>
+#include <cstddef>
+#include <string>
+#include <system_error>
+#include <utility>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+
+namespace colormap {
+namespace detail {
+
+    // A file of fixed size, mapped into memory for writing. The file is
+    // created (or truncated) and sized up front; the mapping is released
+    // when the object is destroyed. Alternatively, an existing file is
+    // mapped read-only.
+    struct mapped_file {
+        mapped_file (std::string const& path, size_t size) : size_(size) {
+            fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+            if (fd < 0)
+                fail("cannot open " + path);
+            if (::ftruncate(fd, off_t(size)) != 0)
+                fail("cannot resize " + path);
+#ifdef __linux__
+            // reserve the blocks now rather than on first touch, if the file
+            // system supports it; posix_fallocate reports errors through
+            // its return value rather than errno
+            if (size > 0) {
+                int err = ::posix_fallocate(fd, 0, off_t(size));
+                if (err != 0 && err != EOPNOTSUPP && err != EINVAL)
+                    fail("cannot allocate " + path, err);
+            }
+#endif
+            if (size > 0) {
+                void * p = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+                if (p == MAP_FAILED)
+                    fail("cannot map " + path);
+                addr = static_cast<char *>(p);
+            }
+        }
+
+        explicit mapped_file (std::string const& path) {
+            fd = ::open(path.c_str(), O_RDONLY);
+            if (fd < 0)
+                fail("cannot open " + path);
+            struct stat st;
+            if (::fstat(fd, &st) != 0)
+                fail("cannot stat " + path);
+            size_ = size_t(st.st_size);
+            if (size_ > 0) {
+                void * p = ::mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+                if (p == MAP_FAILED)
+                    fail("cannot map " + path);
+                addr = static_cast<char *>(p);
+            }
+        }
+
+        mapped_file (mapped_file const&) = delete;
+        mapped_file & operator= (mapped_file const&) = delete;
+
+        ~mapped_file () {
+            release();
+        }
+
+        char * data () const {
+            return addr;
+        }
+
+        size_t size () const {
+            return size_;
+        }
+
+    private:
+        void release () {
+            if (addr)
+                ::munmap(addr, size_);
+            if (fd >= 0)
+                ::close(fd);
+            addr = nullptr;
+            fd = -1;
+        }
+
+        [[noreturn]] void fail (std::string const& what, int err = errno) {
+            release();
+            throw std::system_error(err, std::generic_category(), what);
+        }
+
+        int fd = -1;
+        char * addr = nullptr;
+        size_t size_ = 0;
+    };
+
+}
+}
+
+#endif // defined(__unix__) || defined(__APPLE__)
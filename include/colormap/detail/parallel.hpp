@@ -0,0 +1,79 @@
+// colormap -- color palettes, map iterators, grids, and PPM export
+// Copyright (C) 2018-2019  Jonas Greitemann
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <exception>
+#include <thread>
+#include <vector>
+
+
+namespace colormap {
+namespace detail {
+
+    // number of threads to use when the caller asked for 0, i.e. "all"
+    inline size_t default_threads () {
+        return std::max(1u, std::thread::hardware_concurrency());
+    }
+
+    // Call f(i) for every i in [0, n), distributed over up to `threads`
+    // threads (including the calling one). The first exception thrown by
+    // any call is rethrown once all threads have finished.
+    template <typename F>
+    void parallel_for (size_t n, size_t threads, F && f) {
+        threads = std::min(threads, n);
+        if (threads <= 1) {
+            for (size_t i = 0; i < n; ++i)
+                f(i);
+            return;
+        }
+        std::atomic<size_t> next {0};
+        std::vector<std::exception_ptr> errors(threads);
+        auto work = [&] (size_t t) {
+            try {
+                for (size_t i; (i = next++) < n; )
+                    f(i);
+            } catch (...) {
+                errors[t] = std::current_exception();
+                next = n;
+            }
+        };
+        std::vector<std::thread> workers;
+        workers.reserve(threads - 1);
+        try {
+            for (size_t t = 1; t < threads; ++t)
+                workers.emplace_back(work, t);
+        } catch (...) {
+            // the threads already started must not outlive this frame
+            next = n;
+            for (auto & w : workers)
+                w.join();
+            throw;
+        }
+        work(0);
+        for (auto & w : workers)
+            w.join();
+        for (auto const& e : errors)
+            if (e)
+                std::rethrow_exception(e);
+    }
+
+}
+}
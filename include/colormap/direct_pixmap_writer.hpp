@@ -0,0 +1,325 @@
+// colormap -- color palettes, map iterators, grids, and PPM export
+// Copyright (C) 2018-2019  Jonas Greitemann
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+#pragma once
+
+#include <colormap/detail/direct_file.hpp>
+
+#ifdef COLORMAP_HAVE_DIRECT_IO
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstddef>
+#include <cstring>
+#include <deque>
+#include <exception>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <colormap/pixmap.hpp>
+#include <colormap/detail/aligned_allocator.hpp>
+
+
+namespace colormap {
+
+    // Writes binary PNM files (as `pixmap::write_binary`) with direct I/O on
+    // Linux, so that dumping many frames does not evict other data from the
+    // page cache. The encoded files are cut into chunks of `buffer_size`
+    // bytes, which are written by `queue_depth` I/O threads from a pool of
+    // aligned buffers; writes to several files may be outstanding at once.
+    // `write` only blocks while all buffers are in flight. Errors are
+    // rethrown by the next call to `write` or `wait`.
+    struct direct_pixmap_writer : detail::direct_file_constants<> {
+        explicit direct_pixmap_writer (size_t queue_depth = 4, size_t buffer_size = 1 << 22)
+            : buffer_size(std::max(alignment, buffer_size / alignment * alignment))
+        {
+            queue_depth = std::max<size_t>(1, queue_depth);
+            buffers.resize(queue_depth + 1);
+            for (size_t i = 0; i < buffers.size(); ++i) {
+                buffers[i].resize(this->buffer_size);
+                released.push_back(i);
+            }
+            workers.reserve(queue_depth);
+            try {
+                for (size_t t = 0; t < queue_depth; ++t)
+                    workers.emplace_back([this] { run(); });
+            } catch (...) {
+                stop();
+                throw;
+            }
+        }
+
+        direct_pixmap_writer (direct_pixmap_writer const&) = delete;
+        direct_pixmap_writer & operator= (direct_pixmap_writer const&) = delete;
+
+        // Completes all outstanding writes, but does not report errors;
+        // call `wait` for that.
+        ~direct_pixmap_writer () {
+            drain();
+            stop();
+        }
+
+        // Encode `pmap` and queue it for writing to `path`. Returns once all
+        // of it has been handed to the I/O threads.
+        template <typename ForwardIterator>
+        void write (pixmap<ForwardIterator> const& pmap, std::string const& path) {
+            rethrow();
+            auto f = std::make_shared<file>(path);
+            std::string hdr = pmap.header(true);
+            chunk_stream out {*this, f};
+            out.append(hdr.data(), hdr.size());
+            write_pixels(pmap, out, typename pixmap<ForwardIterator>::packed{});
+            out.close();
+        }
+
+        // Wait until all queued files are written and closed. Rethrows the
+        // first error raised since the last call.
+        void wait () {
+            drain();
+            rethrow();
+        }
+
+        // number of chunks queued or being written
+        size_t pending () const {
+            std::lock_guard<std::mutex> lock(mutex);
+            return buffers.size() - released.size();
+        }
+
+    private:
+        struct file {
+            explicit file (std::string const& path) : out(path) {}
+
+            detail::direct_file out;
+            size_t size = 0;
+            size_t outstanding = 0;
+            bool sealed = false;
+        };
+
+        struct chunk {
+            std::shared_ptr<file> target;
+            size_t buffer;
+            size_t offset;
+            size_t length;
+        };
+
+        // Cuts the output for one file into buffer-sized chunks.
+        struct chunk_stream {
+            direct_pixmap_writer & writer;
+            std::shared_ptr<file> target;
+            size_t buffer = size_t(-1);
+            size_t fill = 0;
+            size_t offset = 0;
+
+            ~chunk_stream () {
+                if (buffer != size_t(-1))
+                    writer.release(buffer);
+            }
+
+            void append (char const * data, size_t n) {
+                while (n > 0) {
+                    if (buffer == size_t(-1))
+                        buffer = writer.acquire();
+                    size_t m = std::min(n, writer.buffer_size - fill);
+                    std::memcpy(writer.buffers[buffer].data() + fill, data, m);
+                    fill += m;
+                    data += m;
+                    n -= m;
+                    if (fill == writer.buffer_size)
+                        submit();
+                }
+            }
+
+            void submit () {
+                // pad to a whole number of blocks; truncated by `finish`
+                size_t length = (fill + alignment - 1) / alignment * alignment;
+                std::fill(writer.buffers[buffer].data() + fill,
+                          writer.buffers[buffer].data() + length, 0);
+                writer.submit({target, buffer, offset, length});
+                offset += fill;
+                buffer = size_t(-1);
+                fill = 0;
+            }
+
+            void close () {
+                if (fill > 0)
+                    submit();
+                writer.seal(target, offset);
+            }
+        };
+
+        template <typename ForwardIterator>
+        static void write_pixels (pixmap<ForwardIterator> const& pmap, chunk_stream & out,
+                                  std::true_type)
+        {
+            using color_type = typename pixmap<ForwardIterator>::color_type;
+            size_t n = pmap.shape.first * pmap.shape.second;
+            if (n > 0)
+                out.append(reinterpret_cast<char const *>(&*pmap.begin),
+                           n * color_type::packed_size());
+        }
+
+        template <typename ForwardIterator>
+        static void write_pixels (pixmap<ForwardIterator> const& pmap, chunk_stream & out,
+                                  std::false_type)
+        {
+            using color_type = typename pixmap<ForwardIterator>::color_type;
+            ForwardIterator it(pmap.begin);
+            const size_t row_size = pmap.shape.first * color_type::packed_size();
+            const size_t rows_per_block = std::max<size_t>(1, out.writer.buffer_size
+                                                           / std::max<size_t>(1, row_size));
+            std::vector<char> block(rows_per_block * row_size);
+            for (size_t i = 0; i < pmap.shape.second; i += rows_per_block) {
+                size_t rows = std::min(rows_per_block, pmap.shape.second - i);
+                char * end = pmap.encode(it, rows * pmap.shape.first, block.data(),
+                                         std::false_type{});
+                out.append(block.data(), end - block.data());
+            }
+        }
+
+        size_t acquire () {
+            std::unique_lock<std::mutex> lock(mutex);
+            released_cv.wait(lock, [this] { return !released.empty(); });
+            size_t b = released.front();
+            released.pop_front();
+            return b;
+        }
+
+        void release (size_t b) {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                released.push_back(b);
+            }
+            released_cv.notify_all();
+        }
+
+        void submit (chunk c) {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                ++c.target->outstanding;
+                queued.push_back(std::move(c));
+            }
+            queued_cv.notify_one();
+        }
+
+        // all chunks of the file are queued; it is complete at `size` bytes
+        void seal (std::shared_ptr<file> const& f, size_t size) {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                f->size = size;
+                f->sealed = true;
+                if (f->outstanding > 0)
+                    return;
+            }
+            finish(*f);
+        }
+
+        void finish (file & f) {
+            try {
+                f.out.finish(f.size);
+            } catch (...) {
+                record(std::current_exception());
+            }
+        }
+
+        void run () {
+            for (;;) {
+                chunk c;
+                {
+                    std::unique_lock<std::mutex> lock(mutex);
+                    queued_cv.wait(lock, [this] { return !queued.empty() || closing; });
+                    if (queued.empty())
+                        return;
+                    c = std::move(queued.front());
+                    queued.pop_front();
+                }
+                try {
+                    c.target->out.write_at(buffers[c.buffer].data(), c.length, c.offset);
+                } catch (...) {
+                    record(std::current_exception());
+                }
+                bool last;
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    released.push_back(c.buffer);
+                    last = --c.target->outstanding == 0 && c.target->sealed;
+                    finishing += last;
+                }
+                if (last) {
+                    finish(*c.target);
+                    std::lock_guard<std::mutex> lock(mutex);
+                    --finishing;
+                }
+                released_cv.notify_all();
+            }
+        }
+
+        void record (std::exception_ptr e) {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (!error)
+                error = e;
+        }
+
+        void rethrow () {
+            std::exception_ptr e;
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                std::swap(e, error);
+            }
+            if (e)
+                std::rethrow_exception(e);
+        }
+
+        // stop the I/O threads, once they have written all queued chunks
+        void stop () {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                closing = true;
+            }
+            queued_cv.notify_all();
+            for (auto & w : workers)
+                w.join();
+        }
+
+        // wait until every buffer is back and all files are finished
+        void drain () {
+            std::unique_lock<std::mutex> lock(mutex);
+            released_cv.wait(lock, [this] {
+                return released.size() == buffers.size() && finishing == 0;
+            });
+        }
+
+        size_t buffer_size;
+        std::vector<std::vector<char, detail::aligned_allocator<char, alignment>>> buffers;
+        std::vector<std::thread> workers;
+
+        mutable std::mutex mutex;
+        std::condition_variable queued_cv;
+        std::condition_variable released_cv;
+        std::deque<chunk> queued;
+        std::deque<size_t> released;
+        size_t finishing = 0;
+        bool closing = false;
+        std::exception_ptr error;
+    };
+
+}
+
+#endif // COLORMAP_HAVE_DIRECT_IO
@@ -0,0 +1,108 @@
+// colormap -- color palettes, map iterators, grids, and PPM export
+// Copyright (C) 2018-2019  Jonas Greitemann
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <iterator>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+
+#include <colormap/grid.hpp>
+#include <colormap/thread_pool.hpp>
+
+
+namespace colormap {
+
+    // Evaluate f at every point of `g` (a `grid` or any other container
+    // with random-access iterators) and store the results in `out`, in the
+    // grid's major order. The points are split into tiles of `tile_size`
+    // consecutive points (by default, about 1024 tiles of at least 256
+    // points each) which are scheduled on `pool`. `f` needs to be safe to
+    // call concurrently.
+    template <typename Grid, typename Functor, typename OutputIterator,
+              typename = typename std::iterator_traits<OutputIterator>::iterator_category>
+    void evaluate (Grid const& g, Functor && f, OutputIterator out,
+                   thread_pool & pool, size_t tile_size = 0)
+    {
+        using iterator = decltype(std::begin(g));
+        static_assert(std::is_base_of<std::random_access_iterator_tag,
+                          typename std::iterator_traits<iterator>::iterator_category>::value,
+                      "evaluate requires random-access iterators");
+        const iterator first = std::begin(g);
+        const size_t n = std::distance(first, std::end(g));
+        if (tile_size == 0)
+            tile_size = std::max<size_t>(256, n / 1024);
+        const size_t tiles = (n + tile_size - 1) / tile_size;
+        pool.run(tiles, [&] (size_t t) {
+            size_t begin = t * tile_size;
+            size_t end = std::min(n, begin + tile_size);
+            iterator it = first + begin;
+            OutputIterator dst = out + begin;
+            for (size_t i = begin; i < end; ++i, ++it, ++dst)
+                *dst = f(*it);
+        });
+    }
+
+    template <typename Grid, typename Functor, typename Output>
+    auto evaluate (Grid const& g, Functor && f, Output && out,
+                   thread_pool & pool, size_t tile_size = 0)
+        -> decltype(out.data(), void())
+    {
+        if (out.size() < size_t(std::distance(std::begin(g), std::end(g))))
+            throw std::length_error("output range smaller than grid");
+        evaluate(g, f, out.data(), pool, tile_size);
+    }
+
+    // Evaluate f at every point of a tiled grid, scheduling one tile per
+    // task, and store the results at the points' positions in the grid's
+    // major order. Tiles which fit into cache help if `f` touches data
+    // that is laid out along a different axis than the major order.
+    template <size_t dim, major_order order, typename T, typename Functor,
+              typename OutputIterator,
+              typename = typename std::iterator_traits<OutputIterator>::iterator_category>
+    void evaluate (grid_tiling<dim, order, T> const& tiles, Functor && f,
+                   OutputIterator out, thread_pool & pool)
+    {
+        pool.run(tiles.size(), [&] (size_t k) {
+            const auto tile = tiles[k];
+            for (auto it = tile.begin(); it != tile.end(); ++it)
+                out[it.index()] = f(*it);
+        });
+    }
+
+    template <size_t dim, major_order order, typename T, typename Functor,
+              typename Output>
+    auto evaluate (grid_tiling<dim, order, T> const& tiles, Functor && f,
+                   Output && out, thread_pool & pool)
+        -> decltype(out.data(), void())
+    {
+        if (out.size() < tiles.points())
+            throw std::length_error("output range smaller than grid");
+        evaluate(tiles, f, out.data(), pool);
+    }
+
+    // Same, on a temporary pool with one thread per hardware thread.
+    template <typename Grid, typename Functor, typename Output>
+    void evaluate (Grid const& g, Functor && f, Output && out) {
+        thread_pool pool;
+        evaluate(g, f, std::forward<Output>(out), pool);
+    }
+
+}
@@ -19,21 +19,101 @@
 
 #include <algorithm>
 #include <array>
+#include <cstdint>
 #include <functional>
 #include <initializer_list>
 #include <iterator>
 #include <memory>
 #include <stdexcept>
 #include <type_traits>
+#include <vector>
+
+#include <colormap/detail/curve.hpp>
 
 
 namespace colormap {
 
 enum class major_order {
     row,
-    col
+    col,
+    // along a space-filling curve through the smallest enclosing cube of
+    // side 2^k, skipping the points outside the grid (2-d and 3-d only)
+    morton,
+    hilbert
 };
 
+namespace detail {
+
+    struct no_curve {
+        no_curve () = default;
+        template <typename Shape>
+        explicit no_curve (Shape const&) {}
+    };
+
+    template <major_order order, size_t dim>
+    struct curve_box_for {
+        using type = no_curve;
+    };
+
+    template <size_t dim>
+    struct curve_box_for<major_order::morton, dim> {
+        using type = curve_box<morton_curve<dim>, dim>;
+    };
+
+    template <size_t dim>
+    struct curve_box_for<major_order::hilbert, dim> {
+        using type = curve_box<hilbert_curve<dim>, dim>;
+    };
+
+}
+
+template <size_t dim, major_order order, typename T, typename>
+struct grid;
+
+template <size_t dim, major_order order, typename T>
+struct grid_tiling;
+
+// Up to W grid points in structure-of-arrays layout, which lets functors
+// process them in SIMD lanes. Coordinates are computed as x0 + i*dx, just
+// as by the grid iterators, so both yield the same values.
+template <typename T, size_t dim, size_t W>
+struct grid_batch {
+    static_assert(W >= 1 && W <= 64, "batch width needs to be between 1 and 64");
+    static constexpr size_t width = W;
+
+    // coordinates along dimension d, one per lane
+    T const* operator[] (size_t d) const {
+        return coords[d];
+    }
+
+    // number of lanes holding grid points; the remaining ones repeat the
+    // last of these
+    size_t size () const {
+        return count;
+    }
+
+    // bit i is set if lane i holds a grid point
+    std::uint64_t mask () const {
+        return count == 64 ? ~std::uint64_t(0) : (std::uint64_t(1) << count) - 1;
+    }
+
+    // position of the point in lane 0 in the grid's major order; lane i
+    // holds the point at position index() + i
+    size_t index () const {
+        return first;
+    }
+
+    template <size_t, major_order, typename, typename>
+    friend struct grid;
+private:
+    alignas(64) T coords[dim][W];
+    size_t first;
+    size_t count;
+};
+
+template <typename T, size_t dim, size_t W>
+constexpr size_t grid_batch<T, dim, W>::width;
+
 template <size_t dim, major_order order = major_order::row, typename T = double,
           typename = typename std::enable_if<std::is_floating_point<T>::value>::type>
 struct grid {
@@ -41,58 +121,30 @@ struct grid {
     using base_iterator = typename base_grid::const_iterator;
     using range_t = typename base_grid::range_t;
 
+    static constexpr bool curve_order = order == major_order::morton
+                                        || order == major_order::hilbert;
+    static_assert(!curve_order || dim == 2 || dim == 3,
+                  "space-filling curve orders are only available for 2-d and 3-d grids");
+
+    // Random-access iterator over the grid points, in the given major
+    // order. It keeps track of its flat index alongside the per-dimension
+    // iterators, so that it is compared and subtracted in O(1) and jumps
+    // ahead in O(dim). Along space-filling curves, it also keeps the curve
+    // index of the point; jumps then take O(log(size)) curve evaluations.
     struct const_iterator {
         typedef std::array<T, dim> value_type;
         typedef long difference_type;
         typedef value_type reference;
         typedef std::unique_ptr<value_type> pointer;
-        typedef std::bidirectional_iterator_tag iterator_category;
+        typedef std::random_access_iterator_tag iterator_category;
         const_iterator & operator++ () {
-            if (order == major_order::row) {
-                auto itit = its.rbegin();
-                auto lastit = its.rend();
-                --lastit;
-                ++(*itit);
-                while (itit->is_end() && itit != lastit) {
-                    itit->reset();
-                    ++itit;
-                    ++(*itit);
-                }
-            } else {
-                auto itit = its.begin();
-                auto lastit = its.end();
-                --lastit;
-                ++(*itit);
-                while (itit->is_end() && itit != lastit) {
-                    itit->reset();
-                    ++itit;
-                    ++(*itit);
-                }
-            }
+            ++flat;
+            step_forward(curve{});
             return *this;
         }
         const_iterator & operator-- () {
-            if (order == major_order::row) {
-                auto itit = its.rbegin();
-                auto lastit = its.rend();
-                --lastit;
-                --(*itit);
-                while (itit->is_begin() && itit != lastit) {
-                    itit->set_to_end();
-                    ++itit;
-                    --(*itit);
-                }
-            } else {
-                auto itit = its.begin();
-                auto lastit = its.end();
-                --lastit;
-                --(*itit);
-                while (itit->is_begin() && itit != lastit) {
-                    itit->set_to_end();
-                    ++itit;
-                    --(*itit);
-                }
-            }
+            --flat;
+            step_backward(curve{});
             return *this;
         }
         const_iterator operator++ (int) {
@@ -105,20 +157,43 @@ struct grid {
             --(*this);
             return old;
         }
+        const_iterator & operator+= (difference_type n) {
+            flat += n;
+            seek(curve{});
+            return *this;
+        }
+        const_iterator & operator-= (difference_type n) {
+            return *this += -n;
+        }
+        friend const_iterator operator+ (const_iterator it, difference_type n) {
+            return it += n;
+        }
+        friend const_iterator operator+ (difference_type n, const_iterator it) {
+            return it += n;
+        }
+        friend const_iterator operator- (const_iterator it, difference_type n) {
+            return it -= n;
+        }
+        friend difference_type operator- (const_iterator const& lhs, const_iterator const& rhs) {
+            return lhs.flat - rhs.flat;
+        }
+        reference operator[] (difference_type n) const {
+            return *(*this + n);
+        }
         template <size_t d, typename = typename std::enable_if<(d < dim)>::type>
         const_iterator & move_forward () {
-            if (order == major_order::row)
-                its.rbegin()[d].move_forward();
-            else
-                its.begin()[d].move_forward();
+            base_iterator & it = axis(d);
+            difference_type before = it.i;
+            it.move_forward();
+            moved(d, it.i - before, curve{});
             return *this;
         }
         template <size_t d, typename = typename std::enable_if<(d < dim)>::type>
         const_iterator & move_backward () {
-            if (order == major_order::row)
-                its.rbegin()[d].move_backward();
-            else
-                its.begin()[d].move_backward();
+            base_iterator & it = axis(d);
+            difference_type before = it.i;
+            it.move_backward();
+            moved(d, it.i - before, curve{});
             return *this;
         }
         reference operator* () const {
@@ -131,40 +206,130 @@ struct grid {
             return pointer(new value_type(**this));
         }
         friend bool operator!= (const_iterator const& lhs, const_iterator const& rhs) {
-            for (size_t i = 0; i < dim; ++i)
-                if (lhs.its[i] != rhs.its[i])
-                    return true;
-            return false;
+            return lhs.flat != rhs.flat;
         }
         friend bool operator== (const_iterator const& lhs, const_iterator const& rhs) {
-            return !(lhs != rhs);
+            return lhs.flat == rhs.flat;
         }
         friend bool operator< (const_iterator const& lhs, const_iterator const& rhs) {
-            if (order == major_order::row) {
-                return std::lexicographical_compare(lhs.its.begin(), lhs.its.end(),
-                                                    rhs.its.begin(), rhs.its.end());
-            } else {
-                return std::lexicographical_compare(lhs.its.rbegin(), lhs.its.rend(),
-                                                    rhs.its.rbegin(), rhs.its.rend());
-            }
+            return lhs.flat < rhs.flat;
         }
         friend bool operator> (const_iterator const& lhs, const_iterator const& rhs) {
-            return !(lhs < rhs || lhs == rhs);
+            return lhs.flat > rhs.flat;
         }
         friend bool operator<= (const_iterator const& lhs, const_iterator const& rhs) {
-            return !(lhs > rhs);
+            return lhs.flat <= rhs.flat;
         }
         friend bool operator>= (const_iterator const& lhs, const_iterator const& rhs) {
-            return !(lhs < rhs);
+            return lhs.flat >= rhs.flat;
         }
         bool in_bulk () const {
             return std::all_of(its.begin(), its.end(),
                                std::mem_fn(&base_iterator::in_bulk));
         }
+        // multi-index of the current point
+        std::array<size_t, dim> indices () const {
+            std::array<size_t, dim> idx;
+            std::transform(its.begin(), its.end(), idx.begin(),
+                           [] (auto const& it) { return it.i; });
+            return idx;
+        }
         friend grid;
     private:
-        const_iterator () : its{} {};
+        using curve = std::integral_constant<bool, curve_order>;
+        using curve_box = typename detail::curve_box_for<order, dim>::type;
+
+        const_iterator () : its{}, flat(0), code(0) {};
+
+        void step_forward (std::false_type) {
+            size_t d = 0;
+            ++axis(d);
+            while (axis(d).is_end() && d + 1 < dim) {
+                axis(d).reset();
+                ++axis(++d);
+            }
+        }
+
+        void step_forward (std::true_type) {
+            detail::curve_point<dim> x;
+            code = box.next(code + 1, x);
+            if (code != box.end())
+                jump_to(x);
+        }
+
+        // axes which are at their first point wrap around to their last
+        // one, borrowing from the next slower axis
+        void step_backward (std::false_type) {
+            size_t d = 0;
+            while (axis(d).is_begin() && d + 1 < dim) {
+                axis(d).set_to_end();
+                --axis(d);
+                ++d;
+            }
+            --axis(d);
+        }
+
+        void step_backward (std::true_type) {
+            detail::curve_point<dim> x;
+            code = box.prev(code - 1, x);
+            jump_to(x);
+        }
+
+        // move the per-dimension iterators to the flat index
+        void seek (std::false_type) {
+            difference_type rest = flat;
+            for (size_t d = 0; d + 1 < dim; ++d) {
+                difference_type size = axis(d).size();
+                axis(d) += rest % size - axis(d).i;
+                rest /= size;
+            }
+            axis(dim - 1) += rest - axis(dim - 1).i;
+        }
+
+        void seek (std::true_type) {
+            code = box.select(flat);
+            if (code != box.end())
+                jump_to(box.decode(code));
+        }
+
+        // update the flat index after moving along the d-th fastest
+        // dimension by `delta` points
+        void moved (size_t d, difference_type delta, std::false_type) {
+            flat += delta * stride(d);
+        }
+
+        void moved (size_t, difference_type, std::true_type) {
+            detail::curve_point<dim> x;
+            for (size_t k = 0; k < dim; ++k)
+                x[k] = std::uint32_t(its[k].i);
+            code = box.encode(x);
+            flat = box.rank(code);
+        }
+
+        void jump_to (detail::curve_point<dim> const& x) {
+            for (size_t k = 0; k < dim; ++k)
+                its[k] += difference_type(x[k]) - its[k].i;
+        }
+
+        // iterator along the d-th fastest-varying dimension (the d-th
+        // dimension for space-filling curves)
+        base_iterator & axis (size_t d) {
+            return its[order == major_order::row ? dim - 1 - d : d];
+        }
+
+        // increment of the flat index per step along the d-th fastest
+        // dimension
+        difference_type stride (size_t d) {
+            difference_type s = 1;
+            for (size_t k = 0; k < d; ++k)
+                s *= axis(k).size();
+            return s;
+        }
+
         std::array<base_iterator, dim> its;
+        difference_type flat;
+        curve_box box;
+        std::uint64_t code;
     };
 
     using grid_point_type = typename const_iterator::value_type;
@@ -175,16 +340,7 @@ struct grid {
 
     const_iterator end () const {
         const_iterator cp(begin_);
-        if (order == major_order::row) {
-            auto lastit = cp.its.rend();
-            --lastit;
-            lastit->set_to_end();
-        } else {
-            auto lastit = cp.its.end();
-            --lastit;
-            lastit->set_to_end();
-        }
-        return cp;
+        return cp += size();
     }
 
     size_t size () const {
@@ -208,6 +364,22 @@ struct grid {
         return s;
     }
 
+    // Partition of the grid into boxes of (at most) `tile_shape` points
+    // along each dimension; see `grid_tiling`.
+    grid_tiling<dim, order, T> tiles (std::array<size_t, dim> const& tile_shape) const {
+        static_assert(!curve_order, "tiles are only available in row- and column-major order");
+        return {*this, tile_shape};
+    }
+
+    // Call f with batches of W consecutive points (see `grid_batch`), in
+    // the grid's major order. In row- and column-major order, batches do not
+    // straddle the fastest-varying dimension: all but the last batch along
+    // it are full and only the coordinate along it differs between lanes.
+    template <size_t W, typename Functor>
+    void for_each_batch (Functor && f) const {
+        batches<W>(f, typename const_iterator::curve{});
+    }
+
     grid (std::initializer_list<base_grid> il) : begin_{} {
         if (il.size() != dim)
             throw std::runtime_error("number of grids does not match dimension");
@@ -216,9 +388,70 @@ struct grid {
             *it = g.begin();
             ++it;
         }
+        begin_.box = typename const_iterator::curve_box(shape());
     }
 
 private:
+    using difference_type = typename const_iterator::difference_type;
+
+    template <size_t W, typename Functor>
+    void batches (Functor & f, std::false_type) const {
+        constexpr size_t fast = order == major_order::row ? dim - 1 : 0;
+        const auto s = shape();
+        const size_t n = s[fast];
+        const size_t rows = size() / n;
+        grid_batch<T, dim, W> batch;
+        std::array<size_t, dim> idx {};
+        for (size_t r = 0; r < rows; ++r) {
+            for (size_t k = 0; k < dim; ++k)
+                if (k != fast)
+                    std::fill_n(batch.coords[k], W, coordinate(k, idx[k]));
+            for (size_t i = 0; i < n; i += W) {
+                batch.first = r * n + i;
+                batch.count = std::min(W, n - i);
+                for (size_t l = 0; l < W; ++l)
+                    batch.coords[fast][l] = coordinate(fast, i + std::min(l, batch.count - 1));
+                f(static_cast<grid_batch<T, dim, W> const&>(batch));
+            }
+            for (size_t d = 1; d < dim; ++d) {
+                size_t k = order == major_order::row ? dim - 1 - d : d;
+                if (++idx[k] < s[k])
+                    break;
+                idx[k] = 0;
+            }
+        }
+    }
+
+    // along space-filling curves, lanes are filled point by point
+    template <size_t W, typename Functor>
+    void batches (Functor & f, std::true_type) const {
+        grid_batch<T, dim, W> batch;
+        batch.first = 0;
+        batch.count = 0;
+        for (auto it = begin(); it != end(); ++it) {
+            const auto p = *it;
+            for (size_t k = 0; k < dim; ++k)
+                batch.coords[k][batch.count] = p[k];
+            if (++batch.count == W) {
+                f(static_cast<grid_batch<T, dim, W> const&>(batch));
+                batch.first += W;
+                batch.count = 0;
+            }
+        }
+        if (batch.count > 0) {
+            for (size_t k = 0; k < dim; ++k)
+                std::fill(batch.coords[k] + batch.count, batch.coords[k] + W,
+                          batch.coords[k][batch.count - 1]);
+            f(static_cast<grid_batch<T, dim, W> const&>(batch));
+        }
+    }
+
+    // i-th coordinate along dimension k, as computed by the iterators
+    T coordinate (size_t k, size_t i) const {
+        base_iterator const& it = begin_.its[k];
+        return it.x0 + difference_type(i) * it.dx;
+    }
+
     const_iterator begin_;
 };
 
@@ -238,14 +471,10 @@ struct grid<1, order, T> {
         typedef T const* pointer;
         typedef std::random_access_iterator_tag iterator_category;
         const_iterator & operator++ () {
-            ++i;
-            x += dx;
-            return *this;
+            return *this += 1;
         }
         const_iterator & operator-- () {
-            --i;
-            x -= dx;
-            return *this;
+            return *this -= 1;
         }
         const_iterator operator++ (int) {
             const_iterator old(*this);
@@ -267,18 +496,18 @@ struct grid<1, order, T> {
         template <size_t d = 0, typename = typename std::enable_if<(d == 0)>::type>
         const_iterator & move_backward () {
             if (is_begin())
-                return set_to_end();
+                set_to_end();
             return --(*this);
         }
+        // The coordinate is computed from the index rather than accumulated,
+        // so that it does not depend on how the iterator got there.
         const_iterator & operator+= (difference_type j) {
             i += j;
-            x += j * dx;
+            x = x0 + i * dx;
             return *this;
         }
         const_iterator & operator-= (difference_type j) {
-            i -= j;
-            x -= j * dx;
-            return *this;
+            return *this += -j;
         }
         bool is_begin () const {
             return i == 0;
@@ -299,7 +528,7 @@ struct grid<1, order, T> {
             return N;
         }
         range_t range () const {
-            return {x - i * dx, x + (N - 1 - i) * dx};
+            return {x0, x0 + (N - 1) * dx};
         }
         reference operator* () const {
             return x;
@@ -340,7 +569,9 @@ struct grid<1, order, T> {
     private:
         const_iterator () = default;
         const_iterator (difference_type i, range_t range, size_t N)
-            : dx((range.second - range.first) / (N-1)), i(i), N(N), x(range.first + i * dx) {}
+            : x0(range.first), dx((range.second - range.first) / (N-1)), i(i), N(N),
+              x(x0 + i * dx) {}
+        T x0;
         T dx;
         difference_type i;
         size_t N;
@@ -371,9 +602,327 @@ struct grid<1, order, T> {
         return { *front(), *back() };
     }
 
+    template <size_t W, typename Functor>
+    void for_each_batch (Functor && f) const {
+        grid_batch<T, 1, W> batch;
+        for (size_t i = 0; i < N; i += W) {
+            batch.first = i;
+            batch.count = std::min(W, N - i);
+            for (size_t l = 0; l < W; ++l) {
+                typename const_iterator::difference_type j = i + std::min(l, batch.count - 1);
+                batch.coords[0][l] = begin_.x0 + j * begin_.dx;
+            }
+            f(static_cast<grid_batch<T, 1, W> const&>(batch));
+        }
+    }
+
 private:
     size_t N;
     const_iterator begin_;
 };
 
+// Cache-blocked traversal of an N-d grid: the grid is cut into tiles, i.e.
+// boxes of `tile_shape` points (smaller at the upper edges), which are
+// enumerated in the grid's major order. Each tile visits its own points in
+// the grid's major order, too, and reports their flat index into the
+// untiled grid, so that results can be stored at their usual positions
+// while the work is handed out tile by tile.
+template <size_t dim, major_order order, typename T>
+struct grid_tiling {
+    using grid_type = grid<dim, order, T>;
+    using grid_iterator = typename grid_type::const_iterator;
+    using shape_type = std::array<size_t, dim>;
+
+    struct tile_iterator;
+
+    struct tile {
+        using const_iterator = tile_iterator;
+
+        const_iterator begin () const {
+            return {*this, 0};
+        }
+
+        const_iterator end () const {
+            return {*this, size()};
+        }
+
+        // multi-index of the tile's first point
+        shape_type const& origin () const {
+            return origin_;
+        }
+
+        // number of points along each dimension
+        shape_type const& shape () const {
+            return shape_;
+        }
+
+        size_t size () const {
+            size_t prod = 1;
+            for (size_t s : shape_)
+                prod *= s;
+            return prod;
+        }
+
+        friend grid_tiling;
+    private:
+        tile (grid_iterator first, shape_type const& grid_shape,
+              shape_type const& origin, shape_type const& shape)
+            : first(first), grid_shape(grid_shape), origin_(origin), shape_(shape) {}
+
+        friend tile_iterator;
+
+        // iterator to the point at multi-index `local` relative to the origin
+        grid_iterator at (shape_type const& local) const {
+            long flat = 0;
+            for (size_t d = dim; d-- > 0; ) {
+                size_t k = axis(d);
+                flat = flat * grid_shape[k] + origin_[k] + local[k];
+            }
+            return first + flat;
+        }
+
+        grid_iterator first;
+        shape_type grid_shape;
+        shape_type origin_;
+        shape_type shape_;
+    };
+
+    // Forward iterator over the points of a tile.
+    struct tile_iterator {
+        typedef typename grid_type::grid_point_type value_type;
+        typedef long difference_type;
+        typedef value_type reference;
+        typedef std::unique_ptr<value_type> pointer;
+        typedef std::forward_iterator_tag iterator_category;
+        tile_iterator & operator++ () {
+            ++pos;
+            size_t k = axis(0);
+            if (++local[k] < t.shape_[k]) {
+                ++it;
+                return *this;
+            }
+            local[k] = 0;
+            for (size_t d = 1; d < dim; ++d) {
+                k = axis(d);
+                if (++local[k] < t.shape_[k])
+                    break;
+                local[k] = 0;
+            }
+            if (pos < t.size())
+                it = t.at(local);
+            return *this;
+        }
+        tile_iterator operator++ (int) {
+            tile_iterator old(*this);
+            ++(*this);
+            return old;
+        }
+        reference operator* () const {
+            return *it;
+        }
+        pointer operator-> () const {
+            return pointer(new value_type(**this));
+        }
+        // position of the current point in the untiled grid
+        size_t index () const {
+            return it - t.first;
+        }
+        friend bool operator== (tile_iterator const& lhs, tile_iterator const& rhs) {
+            return lhs.pos == rhs.pos;
+        }
+        friend bool operator!= (tile_iterator const& lhs, tile_iterator const& rhs) {
+            return !(lhs == rhs);
+        }
+        friend tile;
+    private:
+        tile_iterator (tile const& t, size_t pos)
+            : t(t), it(t.at(shape_type{})), local{}, pos(pos) {}
+        tile t;
+        grid_iterator it;
+        shape_type local;
+        size_t pos;
+    };
+
+    // Random-access iterator over the tiles.
+    struct const_iterator {
+        typedef grid_tiling::tile value_type;
+        typedef long difference_type;
+        typedef value_type reference;
+        typedef std::unique_ptr<value_type> pointer;
+        typedef std::random_access_iterator_tag iterator_category;
+        const_iterator & operator++ () {
+            ++k;
+            return *this;
+        }
+        const_iterator & operator-- () {
+            --k;
+            return *this;
+        }
+        const_iterator operator++ (int) {
+            const_iterator old(*this);
+            ++(*this);
+            return old;
+        }
+        const_iterator operator-- (int) {
+            const_iterator old(*this);
+            --(*this);
+            return old;
+        }
+        const_iterator & operator+= (difference_type n) {
+            k += n;
+            return *this;
+        }
+        const_iterator & operator-= (difference_type n) {
+            k -= n;
+            return *this;
+        }
+        friend const_iterator operator+ (const_iterator it, difference_type n) {
+            return it += n;
+        }
+        friend const_iterator operator+ (difference_type n, const_iterator it) {
+            return it += n;
+        }
+        friend const_iterator operator- (const_iterator it, difference_type n) {
+            return it -= n;
+        }
+        friend difference_type operator- (const_iterator const& lhs, const_iterator const& rhs) {
+            return lhs.k - rhs.k;
+        }
+        reference operator[] (difference_type n) const {
+            return (*tiling)[k + n];
+        }
+        reference operator* () const {
+            return (*tiling)[k];
+        }
+        pointer operator-> () const {
+            return pointer(new value_type(**this));
+        }
+        friend bool operator== (const_iterator const& lhs, const_iterator const& rhs) {
+            return lhs.k == rhs.k;
+        }
+        friend bool operator!= (const_iterator const& lhs, const_iterator const& rhs) {
+            return lhs.k != rhs.k;
+        }
+        friend bool operator< (const_iterator const& lhs, const_iterator const& rhs) {
+            return lhs.k < rhs.k;
+        }
+        friend bool operator> (const_iterator const& lhs, const_iterator const& rhs) {
+            return lhs.k > rhs.k;
+        }
+        friend bool operator<= (const_iterator const& lhs, const_iterator const& rhs) {
+            return lhs.k <= rhs.k;
+        }
+        friend bool operator>= (const_iterator const& lhs, const_iterator const& rhs) {
+            return lhs.k >= rhs.k;
+        }
+        friend grid_tiling;
+    private:
+        const_iterator (grid_tiling const* tiling, difference_type k)
+            : tiling(tiling), k(k) {}
+        grid_tiling const* tiling;
+        difference_type k;
+    };
+
+    grid_tiling (grid_type const& g, shape_type const& tile_shape)
+        : first(g.begin()), grid_shape(g.shape()), tile_shape_(tile_shape)
+    {
+        for (size_t d = 0; d < dim; ++d) {
+            if (tile_shape_[d] == 0)
+                throw std::runtime_error("tile extent needs to be positive");
+            count_[d] = (grid_shape[d] + tile_shape_[d] - 1) / tile_shape_[d];
+        }
+    }
+
+    const_iterator begin () const {
+        return {this, 0};
+    }
+
+    const_iterator end () const {
+        return {this, difference_type(size())};
+    }
+
+    // the k-th tile in the grid's major order
+    tile operator[] (size_t k) const {
+        shape_type origin, shape;
+        for (size_t d = 0; d < dim; ++d) {
+            size_t a = axis(d);
+            origin[a] = k % count_[a] * tile_shape_[a];
+            shape[a] = std::min(tile_shape_[a], grid_shape[a] - origin[a]);
+            k /= count_[a];
+        }
+        return {first, grid_shape, origin, shape};
+    }
+
+    // number of tiles
+    size_t size () const {
+        size_t prod = 1;
+        for (size_t c : count_)
+            prod *= c;
+        return prod;
+    }
+
+    // number of tiles along each dimension
+    shape_type const& count () const {
+        return count_;
+    }
+
+    shape_type const& tile_shape () const {
+        return tile_shape_;
+    }
+
+    // number of points in the untiled grid
+    size_t points () const {
+        size_t prod = 1;
+        for (size_t s : grid_shape)
+            prod *= s;
+        return prod;
+    }
+
+private:
+    using difference_type = typename const_iterator::difference_type;
+
+    // dimension which is the d-th fastest-varying one
+    static constexpr size_t axis (size_t d) {
+        return order == major_order::row ? dim - 1 - d : d;
+    }
+
+    grid_iterator first;
+    shape_type grid_shape;
+    shape_type tile_shape_;
+    shape_type count_;
+};
+
+// Reorder values given in the traversal order of `g` (e.g. along a
+// space-filling curve) into the major order `target`. The default, column
+// major, has the first dimension varying fastest, which is the order of the
+// pixels of a `pixmap` of shape `g.shape()`.
+template <major_order target = major_order::col, size_t dim, major_order order,
+          typename T, typename InputIterator, typename RandomAccessIterator>
+void deswizzle (grid<dim, order, T> const& g, InputIterator first, RandomAccessIterator out) {
+    static_assert(target == major_order::row || target == major_order::col,
+                  "can only deswizzle into row- or column-major order");
+    const auto shape = g.shape();
+    for (auto it = g.begin(); it != g.end(); ++it, ++first) {
+        const auto idx = it.indices();
+        size_t flat = 0;
+        for (size_t d = 0; d < dim; ++d) {
+            size_t k = target == major_order::row ? d : dim - 1 - d;
+            flat = flat * shape[k] + idx[k];
+        }
+        out[flat] = *first;
+    }
+}
+
+template <major_order target = major_order::col, size_t dim, major_order order,
+          typename T, typename Container>
+std::vector<typename Container::value_type> deswizzle (grid<dim, order, T> const& g,
+                                                       Container const& values)
+{
+    if (values.size() < g.size())
+        throw std::length_error("fewer values than grid points");
+    std::vector<typename Container::value_type> out(g.size());
+    deswizzle<target>(g, std::begin(values), out.begin());
+    return out;
+}
+
 }
@@ -0,0 +1,242 @@
+// colormap -- color palettes, map iterators, grids, and PPM export
+// Copyright (C) 2018-2019  Jonas Greitemann
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+#include <colormap/color.hpp>
+#include <colormap/detail/batch.hpp>
+
+
+namespace colormap {
+
+    // The inverse of a colormap: maps a color back to the scalar whose color
+    // is closest to it, i.e. the color is projected onto the nearest segment
+    // of the piecewise-linear curve traced out by the map in color space.
+    // Only the first three channels are compared; the alpha channel of RGBA
+    // colors is ignored. Obtained from `map::inverse`.
+    //
+    // To avoid scanning all segments for each color, the color cube is
+    // divided into 32 cells along each axis and each cell holds the list of
+    // the only segments which may be nearest to a color inside of it.
+    template <typename Color>
+    struct inverse_map {
+        using color_type = Color;
+
+    private:
+        using traits = detail::channel_traits<Color>;
+
+    public:
+        static_assert(traits::batchable,
+                      "inverse maps require 8- or 16-bit integer channels");
+
+        inverse_map (std::pair<double,double> range,
+                     std::vector<double> const& keys,
+                     std::vector<Color> const& colors)
+            : range(range)
+        {
+            if (keys.empty() || keys.size() != colors.size())
+                throw std::runtime_error("inverse map needs at least 1 support");
+            size_t n = keys.size();
+            for (size_t i = 0; i + 1 < n || i == 0; ++i) {
+                size_t j = i + 1 < n ? i + 1 : i;
+                segment s;
+                double len2 = 0.;
+                for (size_t k = 0; k < D; ++k) {
+                    s.origin[k] = traits::get(colors[i], k);
+                    s.dir[k] = double(traits::get(colors[j], k)) - s.origin[k];
+                    len2 += s.dir[k] * s.dir[k];
+                }
+                s.inv_len2 = len2 > 0. ? 1. / len2 : 0.;
+                s.key = keys[i];
+                s.dkey = keys[j] - keys[i];
+                segments.push_back(s);
+            }
+            build_index();
+        }
+
+        double operator() (Color const& c) const {
+            double q[D];
+            for (size_t k = 0; k < D; ++k)
+                q[k] = traits::get(c, k);
+            std::uint32_t const * it = candidates.data() + offsets[cell_of(c)];
+            std::uint32_t const * end = candidates.data() + offsets[cell_of(c) + 1];
+            double best = std::numeric_limits<double>::infinity();
+            double key = segments.front().key;
+            for (; it != end; ++it) {
+                segment const& s = segments[*it];
+                double t;
+                double d2 = s.distance2(q, t);
+                if (d2 < best) {
+                    best = d2;
+                    key = s.key + t * s.dkey;
+                }
+            }
+            return range.first + key * (range.second - range.first);
+        }
+
+        // Batch inversion: out[i] = (*this)(in[i]) for i in [0, n). Images
+        // rendered from a colormap contain few distinct colors, so results
+        // are memoized in a small direct-mapped cache for the duration of
+        // the call.
+        void apply (Color const * in, double * out, size_t n) const {
+            constexpr size_t cache_bits = 12;
+            std::vector<std::uint64_t> tags(size_t(1) << cache_bits, ~std::uint64_t(0));
+            std::vector<double> values(size_t(1) << cache_bits);
+            for (size_t i = 0; i < n; ++i) {
+                std::uint64_t tag = 0;
+                for (size_t k = 0; k < D; ++k)
+                    tag = (tag << 16) | traits::get(in[i], k);
+                size_t slot = (tag * 0x9E3779B97F4A7C15ull) >> (64 - cache_bits);
+                if (tags[slot] != tag) {
+                    tags[slot] = tag;
+                    values[slot] = (*this)(in[i]);
+                }
+                out[i] = values[slot];
+            }
+        }
+
+        template <typename Input, typename Output>
+        auto apply (Input const& in, Output && out) const
+            -> decltype(in.data(), out.data(), void())
+        {
+            if (out.size() < in.size())
+                throw std::length_error("output range smaller than input range");
+            apply(in.data(), out.data(), in.size());
+        }
+
+    private:
+        static constexpr size_t D = traits::count < 3 ? traits::count : 3;
+        static constexpr unsigned bits = detail::fixed_point<typename traits::value_type>::bits;
+        static constexpr unsigned cell_bits = 5;
+        static constexpr unsigned shift = bits - cell_bits;
+        static constexpr size_t cells_per_axis = size_t(1) << cell_bits;
+
+        struct segment {
+            double origin[D];
+            double dir[D];
+            double inv_len2;
+            double key;
+            double dkey;
+
+            // squared distance of q to the segment; t receives the position
+            // of the closest point along it, in [0, 1]
+            double distance2 (double const * q, double & t) const {
+                double dot = 0.;
+                for (size_t k = 0; k < D; ++k)
+                    dot += (q[k] - origin[k]) * dir[k];
+                t = dot * inv_len2;
+                t = t > 0. ? t : 0.;
+                t = t < 1. ? t : 1.;
+                double d2 = 0.;
+                for (size_t k = 0; k < D; ++k) {
+                    double d = q[k] - origin[k] - t * dir[k];
+                    d2 += d * d;
+                }
+                return d2;
+            }
+        };
+
+        size_t cell_of (Color const& c) const {
+            size_t cell = 0;
+            for (size_t k = 0; k < D; ++k)
+                cell = cell * cells_per_axis + (traits::get(c, k) >> shift);
+            return cell;
+        }
+
+        // A segment can only be nearest to some color in a cell if its
+        // distance to the cell does not exceed the distance within which every
+        // color in the cell is guaranteed to find some segment. Both are
+        // bounded using the distance to the cell center and the cell radius;
+        // the former also by the distance to the segment's bounding box. The
+        // cube is refined level by level, each cell only testing the
+        // candidates of its parent.
+        void build_index () {
+            std::vector<std::uint32_t> parent_offsets {0, std::uint32_t(segments.size())};
+            std::vector<std::uint32_t> parent_candidates(segments.size());
+            for (size_t s = 0; s < segments.size(); ++s)
+                parent_candidates[s] = std::uint32_t(s);
+            std::vector<double> lower;
+            for (unsigned level = 1; level <= cell_bits; ++level) {
+                const size_t per_axis = size_t(1) << level;
+                const double width = double(std::uint32_t(1) << (bits - level));
+                const double radius = std::sqrt(double(D)) * (width - 1.) / 2.;
+                size_t n_cells = 1;
+                for (size_t k = 0; k < D; ++k)
+                    n_cells *= per_axis;
+                offsets.assign(1, 0);
+                offsets.reserve(n_cells + 1);
+                candidates.clear();
+                for (size_t cell = 0; cell < n_cells; ++cell) {
+                    double lo[D], hi[D];
+                    size_t parent = 0;
+                    for (size_t k = D, rest = cell; k-- > 0; rest /= per_axis) {
+                        size_t c = rest % per_axis;
+                        lo[k] = c * width;
+                        hi[k] = lo[k] + width - 1.;
+                    }
+                    for (size_t k = 0; k < D; ++k)
+                        parent = parent * (per_axis / 2) + size_t(lo[k] / width) / 2;
+                    std::uint32_t const * first = parent_candidates.data() + parent_offsets[parent];
+                    std::uint32_t const * last = parent_candidates.data() + parent_offsets[parent + 1];
+                    double mid[D];
+                    for (size_t k = 0; k < D; ++k)
+                        mid[k] = (lo[k] + hi[k]) / 2.;
+                    double bound = std::numeric_limits<double>::infinity();
+                    lower.clear();
+                    for (auto it = first; it != last; ++it) {
+                        segment const& seg = segments[*it];
+                        double t;
+                        double center = std::sqrt(seg.distance2(mid, t));
+                        bound = center + radius < bound ? center + radius : bound;
+                        double d2 = 0.;
+                        for (size_t k = 0; k < D; ++k) {
+                            double a = seg.origin[k], b = seg.origin[k] + seg.dir[k];
+                            double s_lo = a < b ? a : b, s_hi = a < b ? b : a;
+                            double gap = s_lo > hi[k] ? s_lo - hi[k]
+                                       : lo[k] > s_hi ? lo[k] - s_hi : 0.;
+                            d2 += gap * gap;
+                        }
+                        double d = std::sqrt(d2);
+                        lower.push_back(d > center - radius ? d : center - radius);
+                    }
+                    for (auto it = first; it != last; ++it)
+                        if (lower[it - first] <= bound)
+                            candidates.push_back(*it);
+                    offsets.push_back(std::uint32_t(candidates.size()));
+                }
+                parent_offsets.swap(offsets);
+                parent_candidates.swap(candidates);
+            }
+            offsets.swap(parent_offsets);
+            candidates.swap(parent_candidates);
+        }
+
+        std::pair<double,double> range;
+        std::vector<segment> segments;
+        // candidate segments of cell i: candidates[offsets[i]..offsets[i+1])
+        std::vector<std::uint32_t> offsets;
+        std::vector<std::uint32_t> candidates;
+    };
+
+}
@@ -17,64 +17,381 @@
 
 #pragma once
 
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
 #include <initializer_list>
+#include <iterator>
 #include <limits>
-#include <map>
+#include <stdexcept>
+#include <type_traits>
 #include <utility>
+#include <vector>
 
+#include <colormap/categorical_map.hpp>
 #include <colormap/color.hpp>
+#include <colormap/detail/aligned_allocator.hpp>
+#include <colormap/detail/batch.hpp>
+#include <colormap/inverse_map.hpp>
 
 
 namespace colormap {
 
+    // A colormap sampled at `size()` equidistant points of its range. Each
+    // lookup is reduced to one multiply-add, a clamp, and an index into a
+    // flat, cache-line-aligned table, picking the nearest sample. Obtained
+    // from `map::bake`.
+    template <typename Color>
+    struct baked_map {
+        using color_type = Color;
+        using table_type = std::vector<Color, detail::aligned_allocator<Color>>;
+
+        baked_map (table_type table, std::pair<double,double> range)
+            : table(std::move(table)) {
+            if (this->table.size() < 2)
+                throw std::runtime_error("baked map needs at least 2 samples");
+            set_range(range);
+        }
+
+        baked_map rescale (double x_min, double x_max) const {
+            baked_map rescaled(*this);
+            rescaled.set_range({x_min, x_max});
+            return rescaled;
+        }
+
+        Color operator() (double x) const {
+            return table[index(x)];
+        }
+
+        // position of the color of x within `colors()`
+        size_t index (double x) const {
+            double t = x * scale + shift;
+            t = t > 0. ? t : 0.;    // also maps NaN to the lower end
+            t = t < last ? t : last;
+            return size_t(t);
+        }
+
+        // Indexed-color output: out[i] = index(in[i]) for i in [0, n), e.g.
+        // for writing palette-based images with `colors()` as the palette.
+        void apply_indices (double const * in, std::uint8_t * out, size_t n) const {
+            if (table.size() > 256)
+                throw std::runtime_error("too many colors for 8-bit indices");
+            for (size_t i = 0; i < n; ++i)
+                out[i] = std::uint8_t(index(in[i]));
+        }
+
+        template <typename Input, typename Output>
+        auto apply_indices (Input const& in, Output && out) const
+            -> decltype(in.data(), out.data(), void())
+        {
+            if (out.size() < in.size())
+                throw std::length_error("output range smaller than input range");
+            apply_indices(in.data(), out.data(), in.size());
+        }
+
+        table_type const& colors () const {
+            return table;
+        }
+
+        size_t size () const {
+            return table.size();
+        }
+
+        std::pair<double,double> range () const {
+            return range_;
+        }
+
+    private:
+        void set_range (std::pair<double,double> range) {
+            range_ = range;
+            last = table.size() - 1;
+            scale = last / (range.second - range.first);
+            shift = 0.5 - range.first * scale;
+        }
+
+        table_type table;
+        std::pair<double,double> range_;
+        double scale;
+        double shift;
+        double last;
+    };
+
+    // A colormap tabulated for every code of an integer type in [lo, hi], for
+    // data which is already quantized (e.g. 8-bit images, 12-bit detector
+    // counts or 16-bit heights). A lookup is a clamp and one table access;
+    // codes outside [lo, hi] map to the end colors. Obtained from
+    // `map::as_lut`.
+    template <typename Color, typename Int>
+    struct lut_map {
+        static_assert(std::is_integral<Int>::value && sizeof(Int) <= 2,
+                      "lookup tables are restricted to 8- and 16-bit codes");
+
+        using color_type = Color;
+        using code_type = Int;
+        using table_type = std::vector<Color, detail::aligned_allocator<Color>>;
+
+        lut_map (table_type table, Int lo)
+            : table(std::move(table)), lo(lo), hi(lo + std::int32_t(this->table.size()) - 1)
+        {
+            if (this->table.empty())
+                throw std::runtime_error("lookup table must not be empty");
+            if (hi > std::numeric_limits<Int>::max())
+                throw std::runtime_error("lookup table exceeds code range");
+            pack(gatherable{});
+        }
+
+        Color operator() (Int code) const {
+            return table[detail::lut_index(code, lo, hi)];
+        }
+
+        // Batch lookup: out[i] = (*this)(in[i]) for i in [0, n). Uses AVX2
+        // gathers (selected at runtime) for 8-bit RGB(A) colors.
+        void apply (Int const * in, Color * out, size_t n) const {
+            detail::gather_batch(table.data(), packed_data(), lo, hi, in, out, n,
+                                 gatherable{});
+        }
+
+        template <typename Input, typename Output>
+        auto apply (Input const& in, Output && out) const
+            -> decltype(in.data(), out.data(), void())
+        {
+            if (out.size() < in.size())
+                throw std::length_error("output range smaller than input range");
+            apply(in.data(), out.data(), in.size());
+        }
+
+        size_t size () const {
+            return table.size();
+        }
+
+        std::pair<Int,Int> code_range () const {
+            return { Int(lo), Int(hi) };
+        }
+
+    private:
+        using gatherable = detail::gatherable<Color>;
+
+        // RGBA tables are gathered from directly; RGB colors are padded to
+        // 32 bits so that a gather never reads past the table.
+        void pack (std::true_type) {
+            packed = detail::pack_colors(table.data(), table.size());
+        }
+
+        void pack (std::false_type) {}
+
+        std::uint32_t const * packed_data () const {
+            if (packed.empty())
+                return reinterpret_cast<std::uint32_t const *>(table.data());
+            return packed.data();
+        }
+
+        table_type table;
+        std::vector<std::uint32_t, detail::aligned_allocator<std::uint32_t>> packed;
+        std::int32_t lo;
+        std::int32_t hi;
+    };
+
     template <typename Color>
     struct map {
         using color_type = Color;
 
-        map (std::initializer_list<Color> il) : range {0, 1} {
-            double step = 1. / (il.size() - 1);
-            size_t i = 0;
-            for (Color const& c : il)
-                supports[(i++) * step] = c;
+        map (std::initializer_list<Color> il)
+            : map(il.begin(), il.end()) {}
+
+        map (std::initializer_list<std::pair<double,Color>> il)
+            : map(il.begin(), il.end()) {}
+
+        // Construct from a range of either colors, which are spaced uniformly,
+        // or of (support point, color) pairs.
+        template <typename ForwardIterator,
+                  typename = decltype(*std::declval<ForwardIterator&>())>
+        map (ForwardIterator first, ForwardIterator last) : range {0, 1} {
+            using value_type = typename std::iterator_traits<ForwardIterator>::value_type;
+            init(first, last, std::is_convertible<value_type, Color>{});
+            tabulate(batchable{});
+        }
+
+        map rescale (double x_min, double x_max) const {
+            map rescaled(*this);
+            rescaled.range = {x_min, x_max};
+            return rescaled;
+        }
+
+        Color operator() (double x) const {
+            x = (x - range.first) / (range.second - range.first);
+            if (!(x > keys.front()))    // also catches NaN
+                return colors.front();
+            if (!(x < keys.back()))
+                return colors.back();
+            size_t i = segment(x);
+            if (keys[i] == x)
+                return colors[i];
+            double mix = (x - keys[i]) / (keys[i+1] - keys[i]);
+            return colors[i].mix(colors[i+1], mix);
+        }
+
+        // Batch colorization: out[i] = (*this)(in[i]) for i in [0, n). Uses
+        // SSE2/AVX2 kernels (selected at runtime) for colors with integer
+        // channels, falling back to scalar evaluation otherwise.
+        void apply (double const * in, Color * out, size_t n) const {
+            apply_impl(in, out, n, batchable{});
+        }
+
+        void apply (float const * in, Color * out, size_t n) const {
+            apply_impl(in, out, n, batchable{});
+        }
+
+        // Overload for contiguous ranges providing `data()` and `size()`,
+        // e.g. `std::vector` or `std::array`.
+        template <typename Input, typename Output>
+        auto apply (Input const& in, Output && out) const
+            -> decltype(in.data(), out.data(), void())
+        {
+            if (out.size() < in.size())
+                throw std::length_error("output range smaller than input range");
+            apply(in.data(), out.data(), in.size());
+        }
+
+        baked_map<Color> bake (size_t n) const {
+            if (n < 2)
+                throw std::runtime_error("baked map needs at least 2 samples");
+            typename baked_map<Color>::table_type table;
+            table.reserve(n);
+            double dx = (range.second - range.first) / (n - 1);
+            for (size_t i = 0; i < n; ++i)
+                table.push_back((*this)(range.first + i * dx));
+            return { std::move(table), range };
+        }
+
+        // Tabulate the map for all integer codes in [lo, hi], each code c
+        // being colored as `(*this)(c)`.
+        template <typename Int>
+        lut_map<Color, Int> as_lut (Int lo = std::numeric_limits<Int>::min(),
+                                    Int hi = std::numeric_limits<Int>::max()) const
+        {
+            if (hi < lo)
+                throw std::runtime_error("empty code range for lookup table");
+            size_t n = size_t(std::int32_t(hi) - std::int32_t(lo)) + 1;
+            std::vector<double> codes(n);
+            for (size_t i = 0; i < n; ++i)
+                codes[i] = std::int32_t(lo) + double(i);
+            typename lut_map<Color, Int>::table_type table(n);
+            apply(codes.data(), table.data(), n);
+            return { std::move(table), lo };
         }
 
-        map (std::initializer_list<std::pair<double,Color>> il) {
+        // The support colors as a categorical map, i.e. without
+        // interpolation, e.g. for qualitative palettes.
+        categorical_map<Color> categorical (category_policy policy = category_policy::wrap) const {
+            return { colors.begin(), colors.end(), policy };
+        }
+
+        // The map from colors back to scalars, for recovering data from
+        // images rendered with this map.
+        inverse_map<Color> inverse () const {
+            return { range, keys, colors };
+        }
+
+    private:
+        template <typename ForwardIterator>
+        void init (ForwardIterator first, ForwardIterator last, std::true_type) {
+            size_t n = std::distance(first, last);
+            double step = 1. / (n - 1);
+            keys.reserve(n);
+            colors.reserve(n);
+            for (size_t i = 0; first != last; ++first) {
+                keys.push_back((i++) * step);
+                colors.push_back(*first);
+            }
+            uniform = true;
+        }
+
+        template <typename ForwardIterator>
+        void init (ForwardIterator first, ForwardIterator last, std::false_type) {
             range = { std::numeric_limits<double>::max(),
                       std::numeric_limits<double>::min() };
-            for (auto p : il) {
-                double & val = p.first;
+            for (auto it = first; it != last; ++it) {
+                double val = it->first;
                 if (range.first > val) range.first = val;
                 if (range.second < val) range.second = val;
             }
-            for (auto p : il) {
-                double & val = p.first;
-                Color & c = p.second;
-                supports[(val - range.first) / (range.second - range.first)] = c;
+            std::vector<std::pair<double,Color>> sorted;
+            for (auto it = first; it != last; ++it) {
+                double val = it->first;
+                sorted.emplace_back((val - range.first) / (range.second - range.first),
+                                    it->second);
+            }
+            std::stable_sort(sorted.begin(), sorted.end(),
+                             [] (auto const& lhs, auto const& rhs) {
+                                 return lhs.first < rhs.first;
+                             });
+            // the last color given for a support point takes precedence
+            for (auto it = sorted.begin(); it != sorted.end(); ++it) {
+                if (it + 1 != sorted.end() && (it + 1)->first == it->first)
+                    continue;
+                keys.push_back(it->first);
+                colors.push_back(it->second);
             }
             range = {0., 1.};
+            double step = 1. / (keys.size() - 1);
+            uniform = true;
+            for (size_t i = 0; i < keys.size(); ++i)
+                uniform = uniform && keys[i] == i * step;
         }
 
-        map rescale (double x_min, double x_max) const {
-            map rescaled(*this);
-            rescaled.range = {x_min, x_max};
-            return rescaled;
+        using batchable = std::integral_constant<bool,
+            detail::channel_traits<Color>::batchable>;
+
+        void tabulate (std::true_type) {
+            channels = detail::channel_tables(colors);
         }
 
-        Color operator() (double x) const {
-            x = (x - range.first) / (range.second - range.first);
-            auto a = supports.lower_bound(x);
-            auto b = supports.upper_bound(x);
-            if (a == supports.end())
-                return (--a)->second;
-            if (b == supports.end() || a == supports.begin() || a->first == x)
-                return a->second;
-            --a;
-            double mix = (x - a->first) / (b->first - a->first);
-            return a->second.mix(b->second, mix);
+        void tabulate (std::false_type) {}
+
+        template <typename Input>
+        void apply_impl (Input const * in, Color * out, size_t n, std::true_type) const {
+            if (keys.size() < 2)
+                return apply_impl(in, out, n, std::false_type{});
+            detail::batch_table<Color> table(range, keys, channels, uniform);
+            detail::apply_batch(table, in, out, n);
         }
 
-    private:
-        std::map<double, Color> supports;
+        template <typename Input>
+        void apply_impl (Input const * in, Color * out, size_t n, std::false_type) const {
+            for (size_t i = 0; i < n; ++i)
+                out[i] = (*this)(in[i]);
+        }
+
+        // Index i of the segment such that keys[i] <= x < keys[i+1], for x
+        // strictly inside the support range.
+        size_t segment (double x) const {
+            size_t n = keys.size();
+            if (uniform) {
+                // floor(x * (n-1)) may be off by one w.r.t. the rounded keys
+                size_t i = size_t(x * (n - 1));
+                i = i < n - 2 ? i : n - 2;
+                if (keys[i] > x)
+                    --i;
+                else if (keys[i+1] <= x)
+                    ++i;
+                return i;
+            }
+            double const * base = keys.data();
+            size_t len = n - 1;
+            while (len > 1) {
+                size_t half = len / 2;
+                base += (base[half] <= x) ? half : 0;
+                len -= half;
+            }
+            return base - keys.data();
+        }
+
+        // supports in structure-of-arrays layout, sorted by key, and for
+        // batchable colors their channel values, one table per channel
+        std::vector<double> keys;
+        std::vector<Color> colors;
+        std::vector<std::int32_t> channels;
+        bool uniform;
         std::pair<double,double> range;
     };
 
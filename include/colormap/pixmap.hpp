@@ -17,15 +17,83 @@
 
 #pragma once
 
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
 #include <iostream>
 #include <iterator>
 #include <sstream>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <vector>
 
 #include <colormap/color.hpp>
+#include <colormap/detail/aligned_allocator.hpp>
+#include <colormap/detail/ascii.hpp>
+#include <colormap/detail/batch.hpp>
+#include <colormap/detail/byteswap.hpp>
+#include <colormap/detail/mapped_file.hpp>
+#include <colormap/detail/parallel.hpp>
 
 
 namespace colormap {
 
+    static_assert(sizeof(color<space::rgb, std::uint8_t>) == 3
+                  && std::is_standard_layout<color<space::rgb, std::uint8_t>>::value,
+                  "8-bit RGB colors need to be packed for zero-copy output");
+
+    namespace detail {
+
+        // Whether the iterator points into contiguous memory, i.e. is a raw
+        // pointer or a `std::vector` iterator.
+        template <typename Iterator,
+                  typename Value = typename std::iterator_traits<Iterator>::value_type>
+        struct is_contiguous_iterator : std::integral_constant<bool,
+            std::is_pointer<Iterator>::value
+            || std::is_same<Iterator, typename std::vector<Value>::iterator>::value
+            || std::is_same<Iterator, typename std::vector<Value>::const_iterator>::value
+            || std::is_same<Iterator, typename std::vector<Value, aligned_allocator<Value>>::iterator>::value
+            || std::is_same<Iterator, typename std::vector<Value, aligned_allocator<Value>>::const_iterator>::value> {};
+
+        // Whether the pixels referred to by the iterator are contiguous
+        // integer channels without padding, i.e. stored as in a binary PNM
+        // file up to the byte order of the channels.
+        template <typename Iterator,
+                  typename Color = typename std::iterator_traits<Iterator>::value_type,
+                  typename Channel = decltype(Color::depth())>
+        struct is_raw_contiguous : std::integral_constant<bool,
+            is_contiguous_iterator<Iterator>::value
+            && std::is_integral<Channel>::value
+            && sizeof(Color) == Color::packed_size()
+            && std::is_standard_layout<Color>::value
+            && std::is_trivially_copyable<Color>::value> {};
+
+        // Whether the pixels referred to by the iterator are stored exactly
+        // as in a binary PNM file: contiguous 8-bit channels (or big-endian
+        // ones on big-endian hosts) without padding.
+        template <typename Iterator,
+                  typename Color = typename std::iterator_traits<Iterator>::value_type>
+        struct is_packed_contiguous : std::integral_constant<bool,
+            is_raw_contiguous<Iterator>::value
+            && (sizeof(decltype(Color::depth())) == 1 || native_big_endian)> {};
+
+        // Whether the pixels are contiguous 16-bit channels in the wrong
+        // byte order, which can be fixed up after a plain copy.
+        template <typename Iterator,
+                  typename Color = typename std::iterator_traits<Iterator>::value_type>
+        struct is_swapped_contiguous : std::integral_constant<bool,
+            is_raw_contiguous<Iterator>::value
+            && sizeof(decltype(Color::depth())) == 2 && !native_big_endian> {};
+
+    }
+
+    template <typename ForwardIterator>
+    struct async_pixmap_writer;
+
+    struct direct_pixmap_writer;
+
     template <typename ForwardIterator>
     struct pixmap {
         using color_type = typename std::iterator_traits<ForwardIterator>::value_type;
@@ -37,35 +105,79 @@ namespace colormap {
         pixmap (ForwardIterator begin, std::array<size_t,2> const& alt_shape)
             : begin(begin), shape{alt_shape[0], alt_shape[1]} {};
 
+        // Each row starts on a new line; lines are wrapped at 70 characters.
+        // There is no plain format for colors with alpha channel.
         std::ostream & write_ascii (std::ostream & os) const {
             ForwardIterator it(begin);
             os << header(false);
+            using traits = detail::channel_traits<color_type>;
+            detail::ascii_writer out(os);
             for (size_t i = 0; i < shape.second; ++i) {
                 for (size_t j = 0; j < shape.first; ++j, ++it) {
-                    os << *it;
+                    color_type pix = *it;
+                    for (size_t k = 0; k < traits::count; ++k)
+                        out.put(traits::get(pix, k));
                 }
-                os << '\n';
+                out.end_line();
             }
+            out.flush();
             return os;
         }
 
+        // Pixels are packed into a buffer holding a block of rows (at least
+        // `block_size` bytes), which is handed to the stream in one call. If
+        // the pixels are already laid out in memory as required, they are
+        // written in one go without being touched. Colors with alpha channel
+        // are written as PAM.
         std::ostream & write_binary (std::ostream & os) const {
-            ForwardIterator it(begin);
             std::string hdr = header(true);
             os.write(hdr.c_str(), hdr.size());
-            for (size_t i = 0; i < shape.second; ++i) {
-                for (size_t j = 0; j < shape.first; ++j, ++it) {
-                    color_type pix = *it;
-                    pix.write(os);
-                }
-            }
-            return os;
+            return write_pixels(os, packed{});
+        }
+
+        // Write a PAM (P7) file with tuple type GRAYSCALE, RGB, or RGB_ALPHA.
+        // The samples are the same as for `write_binary`.
+        std::ostream & write_pam (std::ostream & os) const {
+            std::string hdr = pam_header();
+            os.write(hdr.c_str(), hdr.size());
+            return write_pixels(os, packed{});
+        }
+
+        // Write a binary PNM file to `path` through a shared memory mapping
+        // of the file, sized up front. The rows are split into contiguous
+        // ranges encoded concurrently by `threads` threads (by default, one
+        // per hardware thread) if the iterator is random-access; the functor
+        // behind it then needs to be safe to call concurrently. Falls back
+        // to `write_binary` on platforms without `mmap`.
+        void write_mmap (std::string const& path, size_t threads = 0) const {
+            std::string hdr = header(true);
+#ifdef COLORMAP_HAVE_MMAP
+            const size_t row_size = shape.first * color_type::packed_size();
+            detail::mapped_file file(path, hdr.size() + shape.second * row_size);
+            std::memcpy(file.data(), hdr.data(), hdr.size());
+            char * pixels = file.data() + hdr.size();
+
+            using category = typename std::iterator_traits<ForwardIterator>::iterator_category;
+            threads = threads_for(threads, category{});
+            detail::parallel_for(threads, threads, [&] (size_t t) {
+                size_t first = shape.second * t / threads;
+                size_t last = shape.second * (t + 1) / threads;
+                encode_rows(first, last, pixels + first * row_size);
+            });
+#else
+            (void) threads;
+            std::ofstream os(path, std::ios_base::binary);
+            if (!os)
+                throw std::runtime_error("cannot open " + path);
+            write_binary(os);
+#endif
         }
 
         std::string file_extension () const {
             switch (color_type::color_space()) {
             case space::grayscale: return "pgm";
             case space::rgb:       return "ppm";
+            case space::rgba:      return "pam";
             default:
                 throw std::runtime_error("no extension for color space");
             }
@@ -73,9 +185,90 @@ namespace colormap {
         }
 
     private:
+        template <typename> friend struct async_pixmap_writer;
+        friend struct direct_pixmap_writer;
+
+        static constexpr size_t block_size = 1 << 16;
+
         ForwardIterator begin;
         shape_type shape;
 
+        using packed = detail::is_packed_contiguous<ForwardIterator>;
+        using swapped = detail::is_swapped_contiguous<ForwardIterator>;
+
+        std::ostream & write_pixels (std::ostream & os, std::true_type) const {
+            size_t n = shape.first * shape.second;
+            if (n > 0)
+                os.write(reinterpret_cast<char const *>(&*begin),
+                         n * color_type::packed_size());
+            return os;
+        }
+
+        std::ostream & write_pixels (std::ostream & os, std::false_type) const {
+            ForwardIterator it(begin);
+            const size_t row_size = shape.first * color_type::packed_size();
+            const size_t rows_per_block = std::max<size_t>(1, block_size / std::max<size_t>(1, row_size));
+            std::vector<char> buffer(rows_per_block * row_size);
+            for (size_t i = 0; i < shape.second; i += rows_per_block) {
+                size_t rows = std::min(rows_per_block, shape.second - i);
+                char * end = encode(it, rows * shape.first, buffer.data(), std::false_type{});
+                os.write(buffer.data(), end - buffer.data());
+            }
+            return os;
+        }
+
+        // Pack `count` pixels starting at `it` into `dst`, advancing `it`.
+        char * encode (ForwardIterator & it, size_t count, char * dst, std::true_type) const {
+            size_t bytes = count * color_type::packed_size();
+            if (count > 0)
+                std::memcpy(dst, &*it, bytes);
+            std::advance(it, count);
+            return dst + bytes;
+        }
+
+        char * encode (ForwardIterator & it, size_t count, char * dst, std::false_type) const {
+            return encode_channels(it, count, dst, swapped{});
+        }
+
+        // copy, then fix the byte order of the 16-bit channels in place
+        char * encode_channels (ForwardIterator & it, size_t count, char * dst,
+                                std::true_type) const
+        {
+            char * end = encode(it, count, dst, std::true_type{});
+            detail::byteswap16(dst, (end - dst) / 2);
+            return end;
+        }
+
+        char * encode_channels (ForwardIterator & it, size_t count, char * dst,
+                                std::false_type) const
+        {
+            for (size_t j = 0; j < count; ++j, ++it) {
+                color_type pix = *it;
+                dst = pix.write(dst);
+            }
+            return dst;
+        }
+
+        // Encode rows in [row_begin, row_end) into `dst`, which points to
+        // the first of these rows in the output.
+        void encode_rows (size_t row_begin, size_t row_end, char * dst) const {
+            ForwardIterator it(begin);
+            std::advance(it, row_begin * shape.first);
+            encode(it, (row_end - row_begin) * shape.first, dst, packed{});
+        }
+
+        size_t threads_for (size_t requested, std::random_access_iterator_tag) const {
+            if (requested == 0)
+                requested = detail::default_threads();
+            return std::max<size_t>(1, std::min(requested, shape.second));
+        }
+
+        // without random access, each thread would have to walk the
+        // iterator to its first row
+        size_t threads_for (size_t, std::forward_iterator_tag) const {
+            return 1;
+        }
+
         short magic_number (bool binary) const {
             switch (color_type::color_space()) {
             case space::grayscale: return binary ? 5 : 2;
@@ -87,12 +280,37 @@ namespace colormap {
         }
 
         std::string header (bool binary) const {
+            if (color_type::color_space() == space::rgba) {
+                if (!binary)
+                    throw std::runtime_error("no plain format for colors with alpha channel");
+                return pam_header();
+            }
             std::stringstream ss;
             ss << 'P' << magic_number(binary) << '\n'
                << shape.first << ' ' << shape.second << '\n'
                << size_t(color_type::depth()) << '\n';
             return ss.str();
         }
+
+        std::string pam_header () const {
+            char const * tuple_type;
+            switch (color_type::color_space()) {
+            case space::grayscale: tuple_type = "GRAYSCALE"; break;
+            case space::rgb:       tuple_type = "RGB";       break;
+            case space::rgba:      tuple_type = "RGB_ALPHA"; break;
+            default:
+                throw std::runtime_error("no PAM tuple type for color space");
+            }
+            std::stringstream ss;
+            ss << "P7\n"
+               << "WIDTH " << shape.first << '\n'
+               << "HEIGHT " << shape.second << '\n'
+               << "DEPTH " << detail::channel_traits<color_type>::count << '\n'
+               << "MAXVAL " << size_t(color_type::depth()) << '\n'
+               << "TUPLTYPE " << tuple_type << '\n'
+               << "ENDHDR\n";
+            return ss.str();
+        }
     };
 
 }
@@ -0,0 +1,389 @@
+// colormap -- color palettes, map iterators, grids, and PPM export
+// Copyright (C) 2018-2019  Jonas Greitemann
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+#pragma once
+
+#include <cctype>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <limits>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include <colormap/color.hpp>
+#include <colormap/detail/batch.hpp>
+#include <colormap/detail/mapped_file.hpp>
+
+
+namespace colormap {
+
+    namespace detail {
+
+        // The header of a PNM (P2, P3, P5, P6) or PAM (P7) file. `offset` is
+        // the position of the first sample.
+        struct pnm_header {
+            int format;
+            size_t width;
+            size_t height;
+            size_t depth;
+            size_t maxval;
+            std::string tuple_type;
+            size_t offset;
+
+            bool plain () const {
+                return format == 2 || format == 3;
+            }
+        };
+
+        // Reads whitespace-separated tokens, skipping comments.
+        struct pnm_scanner {
+            char const * data;
+            size_t size;
+            size_t pos;
+
+            void skip_space () {
+                while (pos < size) {
+                    if (data[pos] == '#') {
+                        while (pos < size && data[pos] != '\n')
+                            ++pos;
+                    } else if (std::isspace((unsigned char)data[pos])) {
+                        ++pos;
+                    } else {
+                        break;
+                    }
+                }
+            }
+
+            size_t number () {
+                skip_space();
+                if (pos == size || !std::isdigit((unsigned char)data[pos]))
+                    throw std::runtime_error("malformed PNM file: expected a number");
+                size_t v = 0;
+                for (; pos < size && std::isdigit((unsigned char)data[pos]); ++pos) {
+                    v = 10 * v + size_t(data[pos] - '0');
+                    if (v > 0xFFFFFFFF)
+                        throw std::runtime_error("malformed PNM file: number too large");
+                }
+                return v;
+            }
+
+            std::string line () {
+                size_t end = pos;
+                while (end < size && data[end] != '\n')
+                    ++end;
+                if (end == size)
+                    throw std::runtime_error("malformed PAM file: unterminated header");
+                std::string l(data + pos, end - pos);
+                pos = end + 1;
+                return l;
+            }
+        };
+
+        inline pnm_header parse_pam_header (pnm_scanner & in) {
+            pnm_header h {7, 0, 0, 0, 0, "", 0};
+            bool width = false, height = false, depth = false, maxval = false;
+            for (;;) {
+                std::string l = in.line();
+                size_t b = l.find_first_not_of(" \t\r");
+                if (b == std::string::npos || l[b] == '#')
+                    continue;
+                size_t e = l.find_first_of(" \t\r", b);
+                std::string key = l.substr(b, e == std::string::npos ? e : e - b);
+                std::string value;
+                if (e != std::string::npos) {
+                    size_t vb = l.find_first_not_of(" \t\r", e);
+                    size_t ve = l.find_last_not_of(" \t\r");
+                    if (vb != std::string::npos)
+                        value = l.substr(vb, ve + 1 - vb);
+                }
+                if (key == "ENDHDR")
+                    break;
+                if (key == "TUPLTYPE") {
+                    h.tuple_type += (h.tuple_type.empty() ? "" : " ") + value;
+                    continue;
+                }
+                pnm_scanner field {value.data(), value.size(), 0};
+                size_t v = field.number();
+                if (key == "WIDTH")       { h.width = v; width = true; }
+                else if (key == "HEIGHT") { h.height = v; height = true; }
+                else if (key == "DEPTH")  { h.depth = v; depth = true; }
+                else if (key == "MAXVAL") { h.maxval = v; maxval = true; }
+                else
+                    throw std::runtime_error("malformed PAM file: unknown header line " + key);
+            }
+            if (!width || !height || !depth || !maxval)
+                throw std::runtime_error("malformed PAM file: incomplete header");
+            h.offset = in.pos;
+            return h;
+        }
+
+        inline pnm_header parse_pnm_header (char const * data, size_t size) {
+            if (size < 3 || data[0] != 'P' || data[1] < '2' || data[1] > '7' || data[1] == '4')
+                throw std::runtime_error("not a PGM, PPM, or PAM file");
+            pnm_scanner in {data, size, 2};
+            int format = data[1] - '0';
+            if (format == 7) {
+                if (data[2] != '\n')
+                    throw std::runtime_error("malformed PAM file: bad magic number");
+                in.pos = 3;
+                return parse_pam_header(in);
+            }
+            pnm_header h {format, 0, 0, 0, 0, "", 0};
+            h.depth = format == 2 || format == 5 ? 1 : 3;
+            h.width = in.number();
+            h.height = in.number();
+            h.maxval = in.number();
+            // a single whitespace character precedes the raster
+            if (in.pos == size || !std::isspace((unsigned char)data[in.pos]))
+                throw std::runtime_error("malformed PNM file: no raster after header");
+            h.offset = in.pos + 1;
+            return h;
+        }
+
+    }
+
+    // A read-only image loaded from a binary or plain PGM, PPM, or PAM file.
+    // The samples of binary files are not copied, but read straight from a
+    // memory mapping of the file; those of plain files are parsed into
+    // memory. Pixels are accessed as colors of type `Color` through random-
+    // access iterators, e.g. to feed them back into an `itadpt::map`. The
+    // file needs to match the color type: grayscale, RGB, or RGB_ALPHA, and
+    // 8-bit samples (maxval < 256) or 16-bit ones. Samples are rescaled from
+    // [0, maxval] to the full range of the channel type, rounding to
+    // nearest.
+    template <typename Color>
+    struct pixmap_view {
+    private:
+        using traits = detail::channel_traits<Color>;
+        using channel_type = typename traits::value_type;
+        static constexpr size_t pixel_size = traits::count * sizeof(channel_type);
+        static constexpr std::uint32_t full_maxval = std::numeric_limits<channel_type>::max();
+
+        static_assert(std::is_same<channel_type, std::uint8_t>::value
+                      || std::is_same<channel_type, std::uint16_t>::value,
+                      "PNM supports 8- and 16-bit samples");
+
+    public:
+        using color_type = Color;
+        using shape_type = std::pair<size_t, size_t>;
+
+        // Decodes the (big-endian) samples of a pixel on dereference.
+        struct const_iterator {
+            // holds the decoded color for `operator->`
+            struct arrow_proxy {
+                Color color;
+                Color const * operator-> () const { return &color; }
+            };
+
+            typedef Color value_type;
+            typedef std::ptrdiff_t difference_type;
+            typedef value_type reference;
+            typedef arrow_proxy pointer;
+            typedef std::random_access_iterator_tag iterator_category;
+
+            const_iterator () : p(nullptr), maxval(full_maxval) {}
+            const_iterator (unsigned char const * p, std::uint32_t maxval)
+                : p(p), maxval(maxval) {}
+
+            reference operator* () const {
+                std::int32_t v[traits::count];
+                for (size_t k = 0; k < traits::count; ++k) {
+                    std::uint32_t s = sizeof(channel_type) == 1
+                        ? p[k]
+                        : std::uint32_t(p[2 * k]) << 8 | p[2 * k + 1];
+                    // samples of binary files are not validated, so those
+                    // above maxval are clamped
+                    if (maxval != full_maxval)
+                        s = std::uint32_t((std::uint64_t(s < maxval ? s : maxval) * full_maxval
+                                           + maxval / 2) / maxval);
+                    v[k] = std::int32_t(s);
+                }
+                return traits::make(v);
+            }
+
+            pointer operator-> () const {
+                return {**this};
+            }
+
+            reference operator[] (difference_type i) const {
+                return *(*this + i);
+            }
+
+            const_iterator & operator++ () { p += pixel_size; return *this; }
+            const_iterator & operator-- () { p -= pixel_size; return *this; }
+            const_iterator operator++ (int) { const_iterator old(*this); ++*this; return old; }
+            const_iterator operator-- (int) { const_iterator old(*this); --*this; return old; }
+
+            const_iterator & operator+= (difference_type i) {
+                p += i * difference_type(pixel_size);
+                return *this;
+            }
+
+            const_iterator & operator-= (difference_type i) {
+                return *this += -i;
+            }
+
+            friend const_iterator operator+ (const_iterator it, difference_type i) { return it += i; }
+            friend const_iterator operator+ (difference_type i, const_iterator it) { return it += i; }
+            friend const_iterator operator- (const_iterator it, difference_type i) { return it -= i; }
+
+            friend difference_type operator- (const_iterator const& lhs, const_iterator const& rhs) {
+                return (lhs.p - rhs.p) / difference_type(pixel_size);
+            }
+
+            friend bool operator== (const_iterator const& lhs, const_iterator const& rhs) { return lhs.p == rhs.p; }
+            friend bool operator!= (const_iterator const& lhs, const_iterator const& rhs) { return lhs.p != rhs.p; }
+            friend bool operator< (const_iterator const& lhs, const_iterator const& rhs) { return lhs.p < rhs.p; }
+            friend bool operator> (const_iterator const& lhs, const_iterator const& rhs) { return lhs.p > rhs.p; }
+            friend bool operator<= (const_iterator const& lhs, const_iterator const& rhs) { return lhs.p <= rhs.p; }
+            friend bool operator>= (const_iterator const& lhs, const_iterator const& rhs) { return lhs.p >= rhs.p; }
+
+        private:
+            unsigned char const * p;
+            std::uint32_t maxval;
+        };
+        using iterator = const_iterator;
+        using value_type = Color;
+
+        // Throws std::runtime_error if the file cannot be read, is malformed
+        // or truncated, or does not hold `Color`s.
+        static pixmap_view open (std::string const& path) {
+            pixmap_view view;
+#ifdef COLORMAP_HAVE_MMAP
+            auto file = std::make_shared<detail::mapped_file>(path);
+            char const * data = file->data();
+            size_t size = file->size();
+#else
+            std::ifstream is(path, std::ios_base::binary);
+            if (!is)
+                throw std::runtime_error("cannot open " + path);
+            auto file = std::make_shared<std::vector<char>>(
+                std::istreambuf_iterator<char>(is), std::istreambuf_iterator<char>());
+            char const * data = file->data();
+            size_t size = file->size();
+#endif
+            detail::pnm_header h = detail::parse_pnm_header(data, size);
+            view.check(h);
+            // each sample takes up at least a byte (or a digit)
+            size_t unit = h.plain() ? h.depth : pixel_size;
+            if (h.width > 0 && h.height > size / unit / h.width)
+                throw std::runtime_error("truncated image file " + path);
+            view.shape_ = { h.width, h.height };
+            view.maxval_ = h.maxval;
+            if (h.plain()) {
+                auto samples = std::make_shared<std::vector<unsigned char>>(view.size_bytes());
+                parse_samples(data, size, h, samples->data());
+                view.pixels = samples->data();
+                view.storage = samples;
+            } else {
+                if ((size - h.offset) / pixel_size < view.size())
+                    throw std::runtime_error("truncated image file " + path);
+                view.pixels = reinterpret_cast<unsigned char const *>(data) + h.offset;
+                view.storage = file;
+            }
+            return view;
+        }
+
+        shape_type shape () const {
+            return shape_;
+        }
+
+        size_t size () const {
+            return shape_.first * shape_.second;
+        }
+
+        // largest sample value, as given in the file
+        size_t maxval () const {
+            return maxval_;
+        }
+
+        const_iterator begin () const {
+            return const_iterator(pixels, std::uint32_t(maxval_));
+        }
+
+        const_iterator end () const {
+            return const_iterator(pixels + size_bytes(), std::uint32_t(maxval_));
+        }
+
+        Color operator[] (size_t i) const {
+            return begin()[i];
+        }
+
+        Color operator() (size_t x, size_t y) const {
+            return (*this)[y * shape_.first + x];
+        }
+
+        // The samples in the layout of binary PNM files, e.g. for comparing
+        // images byte by byte. Unlike the colors, they are not rescaled to
+        // the full range of the channel type.
+        unsigned char const * data () const {
+            return pixels;
+        }
+
+        size_t size_bytes () const {
+            return size() * pixel_size;
+        }
+
+    private:
+        pixmap_view () = default;
+
+        void check (detail::pnm_header const& h) const {
+            static char const * const tuple_types[] = {"", "GRAYSCALE", "", "RGB", "RGB_ALPHA"};
+            if (h.depth != traits::count)
+                throw std::runtime_error("image has " + std::to_string(h.depth)
+                                         + " channels, expected "
+                                         + std::to_string(traits::count));
+            if (h.format == 7 && !h.tuple_type.empty()
+                && h.tuple_type != tuple_types[traits::count])
+                throw std::runtime_error("unsupported PAM tuple type " + h.tuple_type);
+            if (h.maxval == 0 || h.maxval > 65535)
+                throw std::runtime_error("invalid maxval " + std::to_string(h.maxval));
+            if ((h.maxval < 256 ? 1 : 2) != sizeof(channel_type))
+                throw std::runtime_error("image has " + std::string(h.maxval < 256 ? "8" : "16")
+                                         + "-bit samples, expected "
+                                         + std::to_string(8 * sizeof(channel_type)));
+        }
+
+        static void parse_samples (char const * data, size_t size, detail::pnm_header const& h,
+                                   unsigned char * out)
+        {
+            detail::pnm_scanner in {data, size, h.offset};
+            size_t n = h.width * h.height * h.depth;
+            for (size_t i = 0; i < n; ++i) {
+                size_t v = in.number();
+                if (v > h.maxval)
+                    throw std::runtime_error("sample exceeds maxval");
+                if (sizeof(channel_type) == 2)
+                    *out++ = (unsigned char)(v >> 8);
+                *out++ = (unsigned char)(v);
+            }
+        }
+
+        std::shared_ptr<void const> storage;
+        unsigned char const * pixels = nullptr;
+        shape_type shape_ {0, 0};
+        size_t maxval_ = 0;
+    };
+
+}
@@ -0,0 +1,417 @@
+// colormap -- color palettes, map iterators, grids, and PPM export
+// Copyright (C) 2018-2019  Jonas Greitemann
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <iterator>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include <colormap/color.hpp>
+#include <colormap/detail/batch.hpp>
+#include <colormap/detail/deflate.hpp>
+#include <colormap/detail/parallel.hpp>
+
+
+namespace colormap {
+
+    // Compression backend of `png_writer`. `automatic` picks zlib if the
+    // library was built with it (COLORMAP_WITH_ZLIB) and the built-in
+    // fixed-Huffman encoder otherwise; `stored` does not compress at all.
+    enum class png_encoder { automatic, zlib, fixed_huffman, stored };
+
+    namespace detail {
+
+        inline void put_be32 (unsigned char * p, std::uint32_t v) {
+            p[0] = (unsigned char)(v >> 24);
+            p[1] = (unsigned char)(v >> 16);
+            p[2] = (unsigned char)(v >> 8);
+            p[3] = (unsigned char)(v);
+        }
+
+        inline void write_png_chunk (std::ostream & os, char const * type,
+                                     unsigned char const * data, size_t size)
+        {
+            if (size > 0x7FFFFFFF)
+                throw std::length_error("PNG chunk too large");
+            unsigned char head[8];
+            put_be32(head, std::uint32_t(size));
+            std::copy(type, type + 4, head + 4);
+            std::uint32_t crc = crc32_update(0, head + 4, 4);
+            crc = crc32_update(crc, data, size);
+            unsigned char tail[4];
+            put_be32(tail, crc);
+            os.write(reinterpret_cast<char const *>(head), 8);
+            os.write(reinterpret_cast<char const *>(data), size);
+            os.write(reinterpret_cast<char const *>(tail), 4);
+        }
+
+        inline unsigned paeth (int a, int b, int c) {
+            int p = a + b - c;
+            int pa = std::abs(p - a), pb = std::abs(p - b), pc = std::abs(p - c);
+            return pa <= pb && pa <= pc ? a : pb <= pc ? b : c;
+        }
+
+        // Apply the PNG filter (None, Sub, Up, Average, or Paeth) which
+        // minimizes the sum of absolute residuals, the heuristic recommended
+        // by the PNG specification. `out` receives the filter type followed
+        // by the n filtered bytes.
+        inline void filter_png_row (unsigned char const * prev, unsigned char const * cur,
+                                    size_t n, size_t bpp, unsigned char * out)
+        {
+            auto residual = [&] (unsigned type, size_t i) {
+                unsigned a = i >= bpp ? cur[i - bpp] : 0;
+                unsigned b = prev[i];
+                unsigned c = i >= bpp ? prev[i - bpp] : 0;
+                switch (type) {
+                case 1:  return (unsigned char)(cur[i] - a);
+                case 2:  return (unsigned char)(cur[i] - b);
+                case 3:  return (unsigned char)(cur[i] - ((a + b) >> 1));
+                case 4:  return (unsigned char)(cur[i] - paeth(a, b, c));
+                default: return cur[i];
+                }
+            };
+            unsigned best = 0;
+            size_t best_sum = size_t(-1);
+            for (unsigned type = 0; type < 5; ++type) {
+                size_t sum = 0;
+                for (size_t i = 0; i < n && sum < best_sum; ++i)
+                    sum += std::abs(int(static_cast<signed char>(residual(type, i))));
+                if (sum < best_sum) {
+                    best_sum = sum;
+                    best = type;
+                }
+            }
+            out[0] = (unsigned char)(best);
+            for (size_t i = 0; i < n; ++i)
+                out[i + 1] = residual(best, i);
+        }
+
+        // samples of indexed-color images: one 8-bit palette index each
+        struct png_index_traits {
+            using value_type = std::uint8_t;
+            static constexpr size_t count = 1;
+
+            static std::uint8_t get (std::uint8_t index, size_t) {
+                return index;
+            }
+        };
+
+    }
+
+    // Writes the pixels of an iterator range as a PNG image, analogous to
+    // `pixmap`. The image is processed in bands of rows which are filtered
+    // and compressed concurrently and written as one IDAT chunk each. Each
+    // band's compressor is primed with the tail of the preceding band (as
+    // done by pigz), so the bands form a single DEFLATE stream at little
+    // cost in compression ratio. Only as many bands as there are threads
+    // are held in memory at any time.
+    //
+    // An iterator over `std::uint8_t` palette indices (as produced by
+    // `baked_map::apply_indices` or `categorical_map::apply_indices`) is
+    // written as an indexed-color image, with the palette (e.g. the map's
+    // `colors()`) given to the constructor and stored once in the file.
+    template <typename ForwardIterator>
+    struct png_writer {
+        using color_type = typename std::iterator_traits<ForwardIterator>::value_type;
+        using shape_type = std::pair<size_t, size_t>;
+
+    private:
+        using indexed = std::is_same<color_type, std::uint8_t>;
+        using traits = typename std::conditional<indexed::value,
+                                                 detail::png_index_traits,
+                                                 detail::channel_traits<color_type>>::type;
+        using channel_type = typename traits::value_type;
+
+    public:
+        static_assert(std::is_same<channel_type, std::uint8_t>::value
+                      || std::is_same<channel_type, std::uint16_t>::value,
+                      "PNG supports 8- and 16-bit channels");
+
+        png_writer (ForwardIterator begin, shape_type shape)
+            : begin(begin), shape(shape) {}
+
+        png_writer (ForwardIterator begin, std::array<size_t,2> const& alt_shape)
+            : begin(begin), shape{alt_shape[0], alt_shape[1]} {}
+
+        // Indexed-color image with a palette of at most 256 colors with
+        // 8-bit channels. Grayscale colors are stored as RGB; the alpha
+        // channel of RGBA colors ends up in a tRNS chunk.
+        template <typename Palette,
+                  typename = decltype(std::declval<Palette const&>().begin())>
+        png_writer (ForwardIterator begin, shape_type shape, Palette const& palette)
+            : begin(begin), shape(shape)
+        {
+            static_assert(indexed::value, "palettes require an iterator over std::uint8_t");
+            set_palette(palette);
+        }
+
+        template <typename Palette,
+                  typename = decltype(std::declval<Palette const&>().begin())>
+        png_writer (ForwardIterator begin, std::array<size_t,2> const& alt_shape,
+                    Palette const& palette)
+            : png_writer(begin, shape_type{alt_shape[0], alt_shape[1]}, palette) {}
+
+        // Compress with `encoder` on `threads` threads (by default, one per
+        // hardware thread). Unless the iterator is random-access, pixels are
+        // read sequentially by the calling thread. The functor behind the
+        // iterator needs to be safe to call concurrently otherwise.
+        std::ostream & write (std::ostream & os,
+                              png_encoder encoder = png_encoder::automatic,
+                              size_t threads = 0) const
+        {
+            if (shape.first == 0 || shape.second == 0)
+                throw std::runtime_error("PNG images must not be empty");
+            if (indexed::value && plte.empty())
+                throw std::runtime_error("indexed PNG images need a palette");
+            encoder = resolve(encoder);
+            if (threads == 0)
+                threads = detail::default_threads();
+
+            static constexpr unsigned char signature[8] = {137, 'P', 'N', 'G', '\r', '\n', 26, '\n'};
+            os.write(reinterpret_cast<char const *>(signature), 8);
+            unsigned char ihdr[13];
+            detail::put_be32(ihdr, std::uint32_t(shape.first));
+            detail::put_be32(ihdr + 4, std::uint32_t(shape.second));
+            ihdr[8] = 8 * sizeof(channel_type);
+            ihdr[9] = color_type_code(indexed{});
+            ihdr[10] = ihdr[11] = ihdr[12] = 0;
+            detail::write_png_chunk(os, "IHDR", ihdr, 13);
+            if (!plte.empty())
+                detail::write_png_chunk(os, "PLTE", plte.data(), plte.size());
+            if (!trns.empty())
+                detail::write_png_chunk(os, "tRNS", trns.data(), trns.size());
+
+            const size_t rows_per_band = std::max<size_t>(1, band_size / row_size());
+            const size_t n_bands = (shape.second + rows_per_band - 1) / rows_per_band;
+            std::vector<band> batch(threads);
+            std::vector<unsigned char> carry(row_size(), 0);    // last row of previous batch
+            std::vector<unsigned char> history;     // filtered tail of previous batch
+            std::uint32_t adler = 1;
+            ForwardIterator it(begin);
+            using random_access = std::is_base_of<std::random_access_iterator_tag,
+                typename std::iterator_traits<ForwardIterator>::iterator_category>;
+
+            for (size_t first_band = 0; first_band < n_bands; first_band += threads) {
+                size_t count = std::min(threads, n_bands - first_band);
+                for (size_t b = 0; b < count; ++b) {
+                    band & bd = batch[b];
+                    bd.first = (first_band + b) * rows_per_band;
+                    bd.rows = std::min(rows_per_band, shape.second - bd.first);
+                    bd.final = first_band + b + 1 == n_bands;
+                    bd.raw.resize((bd.rows + 1) * row_size());
+                }
+                if (!random_access::value)
+                    read_sequentially(it, batch, count, carry);
+                detail::parallel_for(count, threads, [&] (size_t b) {
+                    if (random_access::value)
+                        read_rows(batch[b]);
+                    filter(batch[b]);
+                });
+                detail::parallel_for(count, threads, [&] (size_t b) {
+                    std::vector<unsigned char> const& prev = b > 0 ? batch[b-1].filtered : history;
+                    compress(batch[b], prev, encoder);
+                });
+
+                for (size_t b = 0; b < count; ++b) {
+                    band & bd = batch[b];
+                    adler = detail::adler32_update(adler, bd.filtered.data(), bd.filtered.size());
+                    if (bd.first == 0)
+                        bd.compressed.insert(bd.compressed.begin(), {0x78, 0x9C});
+                    if (bd.final) {
+                        unsigned char trailer[4];
+                        detail::put_be32(trailer, adler);
+                        bd.compressed.insert(bd.compressed.end(), trailer, trailer + 4);
+                    }
+                    detail::write_png_chunk(os, "IDAT", bd.compressed.data(), bd.compressed.size());
+                }
+                band const& last = batch[count - 1];
+                std::copy(last.raw.end() - row_size(), last.raw.end(), carry.begin());
+                history.swap(batch[count - 1].filtered);
+            }
+            detail::write_png_chunk(os, "IEND", nullptr, 0);
+            return os;
+        }
+
+        std::string file_extension () const {
+            return "png";
+        }
+
+    private:
+        // uncompressed bytes per band
+        static constexpr size_t band_size = 1 << 18;
+
+        // Rows [first, first + rows) of the image: `raw` holds the row
+        // preceding them (zero for the first band, as required for
+        // filtering) followed by the rows themselves.
+        struct band {
+            size_t first;
+            size_t rows;
+            bool final;
+            std::vector<unsigned char> raw;
+            std::vector<unsigned char> filtered;
+            std::vector<unsigned char> compressed;
+        };
+
+        static png_encoder resolve (png_encoder encoder) {
+#ifdef COLORMAP_WITH_ZLIB
+            if (encoder == png_encoder::automatic)
+                return png_encoder::zlib;
+#else
+            if (encoder == png_encoder::automatic)
+                return png_encoder::fixed_huffman;
+            if (encoder == png_encoder::zlib)
+                throw std::runtime_error("colormap was built without zlib");
+#endif
+            return encoder;
+        }
+
+        static unsigned char color_type_code (std::true_type) {
+            return 3;
+        }
+
+        static unsigned char color_type_code (std::false_type) {
+            switch (color_type::color_space()) {
+            case space::grayscale: return 0;
+            case space::rgb:       return 2;
+            case space::rgba:      return 6;
+            }
+            throw std::runtime_error("no PNG color type for color space");
+        }
+
+        static constexpr size_t pixel_size () {
+            return traits::count * sizeof(channel_type);
+        }
+
+        size_t row_size () const {
+            return shape.first * pixel_size();
+        }
+
+        template <typename Palette>
+        void set_palette (Palette const& palette) {
+            using palette_traits = detail::channel_traits<
+                typename std::decay<decltype(*palette.begin())>::type>;
+            static_assert(std::is_same<typename palette_traits::value_type, std::uint8_t>::value,
+                          "palette colors need 8-bit channels");
+            for (auto const& c : palette) {
+                for (size_t k = 0; k < 3; ++k)
+                    plte.push_back(palette_traits::get(c, palette_traits::count < 3 ? 0 : k));
+                trns.push_back(palette_traits::count == 4 ? palette_traits::get(c, 3) : 255);
+            }
+            if (plte.empty() || plte.size() > 3 * 256)
+                throw std::runtime_error("PNG palettes hold between 1 and 256 colors");
+            // trailing opaque entries may be omitted, and so may the chunk
+            while (!trns.empty() && trns.back() == 255)
+                trns.pop_back();
+        }
+
+        // PNG samples are big-endian
+        unsigned char * pack (color_type const& pix, unsigned char * dst) const {
+            if (indexed::value && size_t(traits::get(pix, 0)) * 3 >= plte.size())
+                throw std::out_of_range("palette index out of range");
+            for (size_t k = 0; k < traits::count; ++k) {
+                channel_type v = traits::get(pix, k);
+                if (sizeof(channel_type) == 2)
+                    *dst++ = (unsigned char)(v >> 8);
+                *dst++ = (unsigned char)(v);
+            }
+            return dst;
+        }
+
+        void read_rows (band & bd) const {
+            unsigned char * dst = bd.raw.data();
+            size_t row = bd.first;
+            if (row == 0) {
+                std::fill(dst, dst + row_size(), 0);
+                dst += row_size();
+            } else {
+                --row;
+            }
+            ForwardIterator it(begin);
+            std::advance(it, row * shape.first);
+            for (unsigned char * end = bd.raw.data() + bd.raw.size(); dst != end; ++it)
+                dst = pack(*it, dst);
+        }
+
+        void read_sequentially (ForwardIterator & it, std::vector<band> & batch, size_t count,
+                                std::vector<unsigned char> const& carry) const
+        {
+            for (size_t b = 0; b < count; ++b) {
+                band & bd = batch[b];
+                std::vector<unsigned char> const& prev = b > 0 ? batch[b-1].raw : carry;
+                std::copy(prev.end() - row_size(), prev.end(), bd.raw.begin());
+                unsigned char * dst = bd.raw.data() + row_size();
+                for (unsigned char * end = bd.raw.data() + bd.raw.size(); dst != end; ++it)
+                    dst = pack(*it, dst);
+            }
+        }
+
+        void filter (band & bd) const {
+            const size_t n = row_size();
+            bd.filtered.resize(bd.rows * (n + 1));
+            // indices are not numerically related, so filtering them rarely
+            // pays off; the PNG specification recommends filter type None
+            if (indexed::value) {
+                for (size_t r = 0; r < bd.rows; ++r) {
+                    unsigned char * out = bd.filtered.data() + r * (n + 1);
+                    out[0] = 0;
+                    std::copy_n(bd.raw.data() + (r + 1) * n, n, out + 1);
+                }
+                return;
+            }
+            for (size_t r = 0; r < bd.rows; ++r)
+                detail::filter_png_row(bd.raw.data() + r * n, bd.raw.data() + (r + 1) * n,
+                                       n, pixel_size(), bd.filtered.data() + r * (n + 1));
+        }
+
+        static void compress (band & bd, std::vector<unsigned char> const& prev,
+                              png_encoder encoder)
+        {
+            constexpr size_t window = 32768;
+            bd.compressed.clear();
+            if (encoder == png_encoder::stored)
+                return detail::deflate_stored(bd.filtered.data(), bd.filtered.size(),
+                                              bd.final, bd.compressed);
+            // the compressor sees the tail of the preceding band as history
+            size_t history = std::min(window, prev.size());
+            std::vector<unsigned char> input;
+            input.reserve(history + bd.filtered.size());
+            input.insert(input.end(), prev.end() - history, prev.end());
+            input.insert(input.end(), bd.filtered.begin(), bd.filtered.end());
+#ifdef COLORMAP_WITH_ZLIB
+            if (encoder == png_encoder::zlib)
+                return detail::deflate_zlib(input.data(), history, input.size(),
+                                            bd.final, Z_DEFAULT_COMPRESSION, bd.compressed);
+#endif
+            detail::deflate_fixed(input.data(), history, input.size(), bd.final, bd.compressed);
+        }
+
+        ForwardIterator begin;
+        shape_type shape;
+        std::vector<unsigned char> plte;
+        std::vector<unsigned char> trns;
+    };
+
+}
@@ -0,0 +1,269 @@
+// colormap -- color palettes, map iterators, grids, and PPM export
+// Copyright (C) 2018-2019  Jonas Greitemann
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#include <colormap/detail/aligned_allocator.hpp>
+#include <colormap/detail/parallel.hpp>
+
+
+namespace colormap {
+
+    // A fixed set of worker threads executing batches of independent tasks
+    // with work stealing. Each batch of tasks [0, n) is split into one
+    // contiguous range per thread; a thread works through its own range
+    // from the front and, once it runs dry, steals the back half of the
+    // largest remaining range of another thread. Thus, uneven task costs
+    // are balanced while neighboring tasks mostly stay on the same thread.
+    struct thread_pool {
+        // `threads` includes the thread calling `run`; by default, there is
+        // one per hardware thread.
+        explicit thread_pool (size_t threads = 0)
+            : ranges(threads == 0 ? detail::default_threads() : threads)
+        {
+            workers.reserve(ranges.size() - 1);
+            try {
+                for (size_t w = 1; w < ranges.size(); ++w)
+                    workers.emplace_back([this, w] { serve(w); });
+            } catch (...) {
+                stop();
+                throw;
+            }
+        }
+
+        thread_pool (thread_pool const&) = delete;
+        thread_pool & operator= (thread_pool const&) = delete;
+
+        ~thread_pool () {
+            stop();
+        }
+
+        size_t size () const {
+            return ranges.size();
+        }
+
+        // Call f(i) for every i in [0, n) and return once all calls have
+        // completed. The first exception thrown by any call is rethrown;
+        // remaining tasks are skipped then. Batches submitted from several
+        // threads are executed one after the other. Tasks must not submit
+        // batches to the same pool, which would deadlock; doing so throws
+        // std::logic_error instead.
+        template <typename F>
+        void run (size_t n, F && f) {
+            if (in_task())
+                throw std::logic_error("thread_pool::run called from one of its tasks");
+            std::lock_guard<std::mutex> serial(run_mutex);
+            batch<F> b(f);
+            const size_t threads = ranges.size();
+            for (size_t w = 0; w < threads; ++w) {
+                std::lock_guard<std::mutex> lock(ranges[w].mutex);
+                ranges[w].begin = n * w / threads;
+                ranges[w].end = n * (w + 1) / threads;
+            }
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                current = &b;
+                busy = threads - 1;
+                ++generation;
+            }
+            wake.notify_all();
+            work(0, b);
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                done.wait(lock, [this] { return busy == 0; });
+                current = nullptr;
+            }
+            if (b.error)
+                std::rethrow_exception(b.error);
+        }
+
+    private:
+        struct batch_base {
+            virtual void call (size_t i) = 0;
+
+            std::atomic<bool> cancelled {false};
+            std::mutex error_mutex;
+            std::exception_ptr error;
+        };
+
+        template <typename F>
+        struct batch : batch_base {
+            explicit batch (F & f) : f(f) {}
+
+            void call (size_t i) override {
+                f(i);
+            }
+
+            F & f;
+        };
+
+        // the tasks [begin, end) yet to be started by a thread, padded to
+        // avoid false sharing
+        struct alignas(64) range {
+            std::mutex mutex;
+            size_t begin = 0;
+            size_t end = 0;
+        };
+
+        // Marks the pool whose tasks the current thread is executing for as
+        // long as it exists; the scopes of a thread form a stack.
+        struct task_scope {
+            explicit task_scope (thread_pool const * pool)
+                : pool(pool), outer(innermost())
+            {
+                innermost() = this;
+            }
+
+            ~task_scope () {
+                innermost() = outer;
+            }
+
+            static task_scope *& innermost () {
+                thread_local task_scope * scope = nullptr;
+                return scope;
+            }
+
+            thread_pool const * pool;
+            task_scope * outer;
+        };
+
+        bool in_task () const {
+            for (task_scope * s = task_scope::innermost(); s; s = s->outer)
+                if (s->pool == this)
+                    return true;
+            return false;
+        }
+
+        // stop the workers and wait for them to exit
+        void stop () {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                stopping = true;
+            }
+            wake.notify_all();
+            for (auto & w : workers)
+                w.join();
+        }
+
+        void serve (size_t w) {
+            size_t seen = 0;
+            for (;;) {
+                batch_base * b;
+                {
+                    std::unique_lock<std::mutex> lock(mutex);
+                    wake.wait(lock, [&] { return stopping || generation != seen; });
+                    if (stopping)
+                        return;
+                    seen = generation;
+                    b = current;
+                }
+                work(w, *b);
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    --busy;
+                }
+                done.notify_all();
+            }
+        }
+
+        void work (size_t w, batch_base & b) {
+            task_scope scope(this);
+            for (;;) {
+                size_t i;
+                if (!take(w, i) && !steal(w, i))
+                    return;
+                if (b.cancelled)
+                    continue;
+                try {
+                    b.call(i);
+                } catch (...) {
+                    std::lock_guard<std::mutex> lock(b.error_mutex);
+                    if (!b.error)
+                        b.error = std::current_exception();
+                    b.cancelled = true;
+                }
+            }
+        }
+
+        bool take (size_t w, size_t & i) {
+            std::lock_guard<std::mutex> lock(ranges[w].mutex);
+            if (ranges[w].begin == ranges[w].end)
+                return false;
+            i = ranges[w].begin++;
+            return true;
+        }
+
+        // Move the back half of the largest other range to thread w and
+        // start on its first task.
+        bool steal (size_t w, size_t & i) {
+            for (;;) {
+                size_t victim = w;
+                size_t largest = 0;
+                for (size_t v = 0; v < ranges.size(); ++v) {
+                    if (v == w)
+                        continue;
+                    std::lock_guard<std::mutex> lock(ranges[v].mutex);
+                    if (ranges[v].end - ranges[v].begin > largest) {
+                        largest = ranges[v].end - ranges[v].begin;
+                        victim = v;
+                    }
+                }
+                if (largest == 0)
+                    return false;
+                size_t first, last;
+                {
+                    std::lock_guard<std::mutex> lock(ranges[victim].mutex);
+                    range & r = ranges[victim];
+                    if (r.begin == r.end)
+                        continue;   // drained in the meantime
+                    first = r.begin + (r.end - r.begin) / 2;
+                    last = r.end;
+                    r.end = first;
+                }
+                std::lock_guard<std::mutex> lock(ranges[w].mutex);
+                ranges[w].begin = first + 1;
+                ranges[w].end = last;
+                i = first;
+                return true;
+            }
+        }
+
+        std::vector<range, detail::aligned_allocator<range>> ranges;
+        std::vector<std::thread> workers;
+
+        std::mutex run_mutex;
+        std::mutex mutex;
+        std::condition_variable wake;
+        std::condition_variable done;
+        batch_base * current = nullptr;
+        size_t generation = 0;
+        size_t busy = 0;
+        bool stopping = false;
+    };
+
+}
@@ -0,0 +1,107 @@
+// colormap -- color palettes, map iterators, grids, and PPM export
+// Copyright (C) 2018-2019  Jonas Greitemann
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+// Dumping many small and a few huge frames to a directory, through
+// `std::ofstream` and through `direct_pixmap_writer`, reporting the time
+// taken and how much the page cache grew. Not run by ctest; pass the output
+// directory as the first argument (by default, the working directory).
+
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <colormap/direct_pixmap_writer.hpp>
+#include <colormap/palettes.hpp>
+#include <colormap/pixmap.hpp>
+
+
+using namespace colormap;
+
+namespace {
+    // size of the page cache in MB, according to /proc/meminfo
+    double cached_mb () {
+        std::ifstream is("/proc/meminfo");
+        std::string key;
+        double kb;
+        std::string unit;
+        while (is >> key >> kb >> unit)
+            if (key == "Cached:")
+                return kb / 1024;
+        return 0;
+    }
+
+    template <typename F>
+    void report (std::string const& name, size_t bytes, F && f) {
+        double cached = cached_mb();
+        auto start = std::chrono::steady_clock::now();
+        f();
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        std::cout << name << ": " << elapsed.count() << " s, "
+                  << bytes / elapsed.count() / 1e6 << " MB/s, page cache "
+                  << (cached_mb() - cached >= 0 ? "+" : "") << cached_mb() - cached << " MB\n";
+    }
+}
+
+int main (int argc, char ** argv) {
+#ifdef COLORMAP_HAVE_DIRECT_IO
+    std::string dir = argc > 1 ? std::string(argv[1]) + "/" : "";
+    using rgb = color<space::rgb>;
+
+    for (auto job : {std::make_pair(256, 2000), std::make_pair(8192, 3)}) {
+        size_t edge = job.first;
+        size_t frames = job.second;
+        std::vector<double> values(edge * edge);
+        for (size_t i = 0; i < values.size(); ++i)
+            values[i] = double(i % edge) / edge;
+        std::vector<rgb> frame(values.size());
+        palettes.at("inferno").apply(values, frame);
+        pixmap<rgb const *> pmap(frame.data(), std::make_pair(edge, edge));
+        const size_t bytes = frames * frame.size() * rgb::packed_size();
+        auto path = [&] (size_t i) {
+            return dir + "bench-direct-" + std::to_string(i) + ".ppm";
+        };
+        std::string label = std::to_string(frames) + " x " + std::to_string(edge)
+            + "^2 frames";
+
+        report("std::ofstream, " + label, bytes, [&] {
+            for (size_t i = 0; i < frames; ++i) {
+                std::ofstream os(path(i), std::ios_base::binary);
+                pmap.write_binary(os);
+            }
+        });
+        for (size_t i = 0; i < frames; ++i)
+            std::remove(path(i).c_str());
+
+        report("direct_pixmap_writer, " + label, bytes, [&] {
+            direct_pixmap_writer writer;
+            for (size_t i = 0; i < frames; ++i)
+                writer.write(pmap, path(i));
+            writer.wait();
+        });
+        for (size_t i = 0; i < frames; ++i)
+            std::remove(path(i).c_str());
+    }
+#else
+    (void) argc;
+    (void) argv;
+    std::cout << "direct I/O is not supported on this platform\n";
+#endif
+}
@@ -0,0 +1,123 @@
+// colormap -- color palettes, map iterators, grids, and PPM export
+// Copyright (C) 2018-2019  Jonas Greitemann
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+
+// The mandelbrot set of the mandelbrot test, evaluated on one thread point by
+// point and in batches of 4, 8, and 16 lanes, whose inner loops the compiler
+// can vectorize. If it contracts to FMA in one version but not the other (as
+// with -march=native), points close to the boundary of the set come out
+// differently. Not run by ctest.
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <complex>
+#include <cstddef>
+#include <iostream>
+#include <vector>
+
+#include <colormap/grid.hpp>
+
+
+using namespace colormap;
+
+namespace {
+    const size_t max_it = 1000;
+    const double bail_out = 65536.;
+
+    double smooth (size_t it, double norm) {
+        if (it == max_it)
+            return 0.;
+        double log2_z = std::log(norm) * 0.5 / std::log(2);
+        double nu = std::log(log2_z) / std::log(2);
+        return std::pow(it + 1 - nu, 0.1);
+    }
+
+    double mandelbrot (std::array<double, 2> const& c_arr) {
+        std::complex<double> c { c_arr[0], c_arr[1] };
+        std::complex<double> z = 0.;
+        size_t it;
+        for (it = 0; it < max_it && std::norm(z) < bail_out; ++it)
+            z = z * z + c;
+        return smooth(it, std::norm(z));
+    }
+
+    // All lanes iterate until the last one has escaped; lanes which have
+    // escaped already keep their z.
+    template <size_t W>
+    void mandelbrot (grid_batch<double, 2, W> const& batch, double * out) {
+        double const* cr = batch[0];
+        double const* ci = batch[1];
+        double zr[W] = {}, zi[W] = {}, n[W] = {};
+        for (size_t it = 0; it < max_it; ++it) {
+            int any = 0;
+            for (size_t l = 0; l < W; ++l) {
+                double r2 = zr[l] * zr[l];
+                double i2 = zi[l] * zi[l];
+                bool active = r2 + i2 < bail_out;
+                double zi_next = 2 * zr[l] * zi[l] + ci[l];
+                double zr_next = r2 - i2 + cr[l];
+                zr[l] = active ? zr_next : zr[l];
+                zi[l] = active ? zi_next : zi[l];
+                n[l] += active ? 1. : 0.;
+                any |= active;
+            }
+            if (!any)
+                break;
+        }
+        for (size_t l = 0; l < batch.size(); ++l)
+            out[l] = smooth(size_t(n[l]), zr[l] * zr[l] + zi[l] * zi[l]);
+    }
+
+    template <typename F>
+    double seconds (F && f) {
+        auto start = std::chrono::steady_clock::now();
+        f();
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        return elapsed.count();
+    }
+
+    template <size_t W, typename Grid>
+    void run_batched (Grid const& g, std::vector<double> const& scalar) {
+        std::vector<double> out(g.size());
+        double t = seconds([&] {
+            g.template for_each_batch<W>([&] (auto const& batch) {
+                mandelbrot(batch, out.data() + batch.index());
+            });
+        });
+        double dev = 0;
+        for (size_t i = 0; i < out.size(); ++i)
+            dev = std::max(dev, std::abs(out[i] - scalar[i]));
+        std::cout << W << " lanes: " << t << " s (max. deviation " << dev << ")\n";
+    }
+}
+
+int main () {
+    grid<2, major_order::col> g { {701, {-2.5, 1.}}, {401, {-1., 1.}} };
+
+    std::vector<double> scalar(g.size());
+    double t = seconds([&] {
+        std::transform(g.begin(), g.end(), scalar.begin(),
+                       [] (auto const& p) { return mandelbrot(p); });
+    });
+    std::cout << "point by point: " << t << " s\n";
+
+    run_batched<4>(g, scalar);
+    run_batched<8>(g, scalar);
+    run_batched<16>(g, scalar);
+}
@@ -0,0 +1,70 @@
+// colormap -- color palettes, map iterators, grids, and PPM export
+// Copyright (C) 2018-2019  Jonas Greitemann
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+
+// Sampling a field which is stored transposed with respect to the grid's
+// major order, so that consecutive grid points are a full row of the field
+// apart. Compares plain evaluation with tiled evaluation for a few tile
+// shapes. Not run by ctest.
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <iostream>
+#include <vector>
+
+#include <colormap/evaluate.hpp>
+#include <colormap/grid.hpp>
+#include <colormap/thread_pool.hpp>
+
+
+using namespace colormap;
+
+namespace {
+    template <typename F>
+    double seconds (F && f) {
+        auto start = std::chrono::steady_clock::now();
+        f();
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        return elapsed.count();
+    }
+}
+
+int main () {
+    const size_t edge = 4096;
+    std::vector<float> field(edge * edge);
+    for (size_t i = 0; i < field.size(); ++i)
+        field[i] = float(i % 7919);
+
+    // grid coordinates are the indices themselves
+    grid<2> g {{edge, {0., edge - 1.}}, {edge, {0., edge - 1.}}};
+    auto sample = [&] (auto const& p) {
+        size_t i = size_t(p[0] + 0.5);
+        size_t j = size_t(p[1] + 0.5);
+        return field[j * edge + i];
+    };
+
+    thread_pool pool;
+    std::vector<float> out(g.size());
+    std::cout << "untiled: " << seconds([&] { evaluate(g, sample, out, pool); }) << " s\n";
+    for (size_t t : {16, 64, 256}) {
+        std::array<size_t, 2> tile_shape {{t, t}};
+        std::cout << t << 'x' << t << " tiles: "
+                  << seconds([&] { evaluate(g.tiles(tile_shape), sample, out, pool); })
+                  << " s\n";
+    }
+}
@@ -0,0 +1,177 @@
+// colormap -- color palettes, map iterators, grids, and PPM export
+// Copyright (C) 2018-2019  Jonas Greitemann
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+// Throughput of the binary PNM writer on an 8K x 8K image, compared to
+// writing one pixel at a time. Output goes to a stream buffer that merely
+// counts bytes, so that only the encoder is measured. If a path is given as
+// the second argument, writing an actual file through a stream and through a
+// memory mapping are compared as well. Not run by ctest; pass the edge
+// length as the first argument to benchmark other sizes.
+//
+// A stream buffer which sleeps for every write, emulating storage with a
+// bandwidth of 1 GB/s, shows how much of the I/O time the asynchronous
+// writer hides behind computing the pixels.
+
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <streambuf>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <colormap/async_pixmap_writer.hpp>
+#include <colormap/map.hpp>
+#include <colormap/palettes.hpp>
+#include <colormap/pixmap.hpp>
+#include <colormap/itadpt/map_iterator_adapter.hpp>
+
+
+using namespace colormap;
+
+namespace {
+    struct counting_buf : std::streambuf {
+        size_t count = 0;
+
+    protected:
+        int_type overflow (int_type ch) override {
+            ++count;
+            return ch;
+        }
+
+        std::streamsize xsputn (char const *, std::streamsize n) override {
+            count += n;
+            return n;
+        }
+    };
+
+    struct slow_buf : counting_buf {
+    protected:
+        std::streamsize xsputn (char const * s, std::streamsize n) override {
+            std::this_thread::sleep_for(std::chrono::nanoseconds(n));
+            return counting_buf::xsputn(s, n);
+        }
+    };
+
+    template <typename F>
+    void report (std::string const& name, size_t bytes, F && f) {
+        auto start = std::chrono::steady_clock::now();
+        f();
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        std::cout << name << ": " << elapsed.count() << " s, "
+                  << bytes / elapsed.count() / 1e6 << " MB/s\n";
+    }
+}
+
+int main (int argc, char ** argv) {
+    size_t edge = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 8192;
+    using rgb = color<space::rgb>;
+
+    std::vector<double> values(edge * edge);
+    for (size_t i = 0; i < values.size(); ++i)
+        values[i] = double(i % edge) / edge;
+    std::vector<rgb> frame(values.size());
+    palettes.at("inferno").apply(values, frame);
+    const size_t bytes = frame.size() * rgb::packed_size();
+
+    {
+        counting_buf buf;
+        std::ostream os(&buf);
+        report("per-pixel writes", bytes, [&] {
+            for (auto const& pix : frame)
+                pix.write(os);
+        });
+    }
+
+    {
+        counting_buf buf;
+        std::ostream os(&buf);
+        pixmap<std::vector<rgb>::const_iterator> pmap(frame.cbegin(), std::make_pair(edge, edge));
+        report("pixmap::write_binary (frame buffer)", bytes, [&] {
+            pmap.write_binary(os);
+        });
+    }
+
+    {
+        counting_buf buf;
+        std::ostream os(&buf);
+        auto baked = palettes.at("inferno").bake(1024);
+        auto pix = itadpt::map(values, baked);
+        pixmap<decltype(pix.begin())> pmap(pix.begin(), std::make_pair(edge, edge));
+        report("pixmap::write_binary (mapped values)", bytes, [&] {
+            pmap.write_binary(os);
+        });
+    }
+
+    {
+        counting_buf buf;
+        std::ostream os(&buf);
+        pixmap<std::vector<rgb>::const_iterator> pmap(frame.cbegin(), std::make_pair(edge, edge));
+        report("pixmap::write_ascii (frame buffer)", bytes, [&] {
+            pmap.write_ascii(os);
+        });
+        std::cout << "  (" << buf.count / 1e6 << " MB of text)\n";
+    }
+
+    {
+        counting_buf buf;
+        std::ostream os(&buf);
+        using rgba16 = color<space::rgba, std::uint16_t>;
+        std::vector<rgba16> deep;
+        deep.reserve(frame.size());
+        for (auto const& pix : frame)
+            deep.push_back(rgba16 {std::uint16_t(pix.getRed().getValue() * 257),
+                                   std::uint16_t(pix.getGreen().getValue() * 257),
+                                   std::uint16_t(pix.getBlue().getValue() * 257),
+                                   std::uint16_t(65535)});
+        pixmap<std::vector<rgba16>::const_iterator> pmap(deep.cbegin(), std::make_pair(edge, edge));
+        report("pixmap::write_pam (16-bit RGBA frame buffer)", deep.size() * rgba16::packed_size(), [&] {
+            pmap.write_pam(os);
+        });
+    }
+
+    {
+        auto pal = palettes.at("inferno");
+        auto pix = itadpt::map(values, pal);
+        pixmap<decltype(pix.begin())> pmap(pix.begin(), std::make_pair(edge, edge));
+        slow_buf sync_buf, async_buf;
+        std::ostream sync_os(&sync_buf), async_os(&async_buf);
+        report("pixmap::write_binary (mapped values, 1 GB/s sink)", bytes, [&] {
+            pmap.write_binary(sync_os);
+        });
+        report("async_pixmap_writer (mapped values, 1 GB/s sink)", bytes, [&] {
+            async_pixmap_writer<decltype(pix.begin())> writer(pmap, async_os);
+            writer.write();
+        });
+    }
+
+    if (argc > 2) {
+        std::string path = argv[2];
+        auto baked = palettes.at("inferno").bake(1024);
+        auto pix = itadpt::map(values, baked);
+        pixmap<decltype(pix.begin())> pmap(pix.begin(), std::make_pair(edge, edge));
+        report("pixmap::write_binary (std::ofstream)", bytes, [&] {
+            std::ofstream os(path, std::ios_base::binary);
+            pmap.write_binary(os);
+        });
+        report("pixmap::write_mmap", bytes, [&] {
+            pmap.write_mmap(path);
+        });
+    }
+}
@@ -0,0 +1,114 @@
+// colormap -- color palettes, map iterators, grids, and PPM export
+// Copyright (C) 2018-2019  Jonas Greitemann
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+#define DOCTEST_CONFIG_IMPLEMENT_WITH_MAIN
+
+#include <cmath>
+#include <cstdint>
+#include <random>
+
+#include <doctest/doctest.h>
+
+#include <colormap/color.hpp>
+
+
+using namespace colormap;
+
+TEST_CASE("mix-8bit-rounds-to-nearest") {
+    using rgba = color<space::rgba>;
+    rgba a {0, 10, 255, 100};
+    rgba b {255, 11, 0, 101};
+    for (int i = 0; i <= 256; ++i) {
+        double mix = i / 256.;
+        rgba m = a.mix(b, mix);
+        for (size_t k = 0; k < 4; ++k) {
+            double exact = a.getChannel(k).getValue() * (1. - mix)
+                + b.getChannel(k).getValue() * mix;
+            CHECK(std::abs(m.getChannel(k).getValue() - exact) <= 0.5);
+        }
+    }
+    CHECK(a.mix(b, 0.).getRed().getValue() == 0);
+    CHECK(a.mix(b, 1.).getRed().getValue() == 255);
+    CHECK(a.mix(b, 0.5).getRed().getValue() == 128);
+}
+
+TEST_CASE("mix-16bit-rounds-to-nearest") {
+    using rgb16 = color<space::rgb, std::uint16_t>;
+    rgb16 a {0, 1000, 65535};
+    rgb16 b {65535, 1001, 0};
+    for (int i = 0; i <= 1024; ++i) {
+        double mix = i / 1024.;
+        rgb16 m = a.mix(b, mix);
+        for (size_t k = 0; k < 3; ++k) {
+            double exact = a.getChannel(k).getValue() * (1. - mix)
+                + b.getChannel(k).getValue() * mix;
+            CHECK(std::abs(m.getChannel(k).getValue() - exact) <= 0.5);
+        }
+    }
+}
+
+namespace {
+    template <typename T>
+    T & channel (color<space::grayscale, T> & c, size_t) {
+        return c.getValue();
+    }
+
+    template <typename T, size_t N>
+    T & channel (basic_color<T, N> & c, size_t k) {
+        return c.getChannel(k).getValue();
+    }
+
+    // Mix random colors with random ratios and compare every channel to the
+    // correctly rounded interpolant.
+    template <typename Color, typename Channel>
+    void check_mix_rounding (size_t samples) {
+        std::mt19937 rng(42);
+        std::uniform_int_distribution<unsigned> value(0, Color::depth());
+        std::uniform_real_distribution<double> ratio(0., 1.);
+        const size_t n = Color::packed_size() / sizeof(Channel);
+        size_t wrong = 0;
+        for (size_t s = 0; s < samples; ++s) {
+            Color a, b;
+            for (size_t k = 0; k < n; ++k) {
+                channel(a, k) = Channel(value(rng));
+                channel(b, k) = Channel(value(rng));
+            }
+            double mix = ratio(rng);
+            Color m = a.mix(b, mix);
+            for (size_t k = 0; k < n; ++k) {
+                double va = channel(a, k);
+                double vb = channel(b, k);
+                if (channel(m, k) != std::lround(va * (1. - mix) + vb * mix))
+                    ++wrong;
+            }
+        }
+        CHECK(wrong == 0);
+    }
+}
+
+TEST_CASE("mix-rounds-arbitrary-ratios") {
+    check_mix_rounding<color<space::grayscale>, std::uint8_t>(100000);
+    check_mix_rounding<color<space::rgba>, std::uint8_t>(100000);
+    check_mix_rounding<color<space::grayscale, std::uint16_t>, std::uint16_t>(100000);
+    check_mix_rounding<color<space::rgb, std::uint16_t>, std::uint16_t>(100000);
+}
+
+TEST_CASE("mix-grayscale") {
+    using gray = color<space::grayscale>;
+    CHECK(gray {100}.mix(gray {201}, 0.5).getValue() == 151);
+    CHECK(gray {0}.mix(gray {255}, 1. / 3).getValue() == 85);
+}
@@ -0,0 +1,161 @@
+// colormap -- color palettes, map iterators, grids, and PPM export
+// Copyright (C) 2018-2019  Jonas Greitemann
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+#define DOCTEST_CONFIG_IMPLEMENT_WITH_MAIN
+
+#include <array>
+#include <atomic>
+#include <cmath>
+#include <stdexcept>
+#include <vector>
+
+#include <doctest/doctest.h>
+
+#include <colormap/evaluate.hpp>
+#include <colormap/grid.hpp>
+#include <colormap/thread_pool.hpp>
+#include <colormap/itadpt/map_iterator_adapter.hpp>
+
+
+using namespace colormap;
+
+TEST_CASE("thread-pool") {
+    for (size_t threads : {1, 2, 5}) {
+        thread_pool pool(threads);
+        CHECK(pool.size() == threads);
+        for (size_t n : {0, 1, 3, 1000}) {
+            std::vector<std::atomic<int>> calls(n);
+            for (auto & c : calls)
+                c = 0;
+            // very uneven task costs, so that threads need to steal
+            pool.run(n, [&] (size_t i) {
+                volatile double x = 0;
+                for (size_t k = 0; k < (i < 10 ? 100000 : 10); ++k)
+                    x = x + std::sqrt(double(k));
+                ++calls[i];
+            });
+            for (auto const& c : calls)
+                CHECK(c == 1);
+        }
+
+        std::atomic<int> started {0};
+        CHECK_THROWS_AS(pool.run(100, [&] (size_t i) {
+            ++started;
+            if (i == 42)
+                throw std::runtime_error("task failed");
+        }), std::runtime_error);
+        CHECK(started <= 100);
+
+        // still usable afterwards
+        std::atomic<size_t> sum {0};
+        pool.run(10, [&] (size_t i) { sum += i; });
+        CHECK(sum == 45);
+
+        // nested submission to the same pool is refused rather than
+        // deadlocking, while other pools can be used from within tasks
+        CHECK_THROWS_AS(pool.run(10, [&] (size_t) {
+            pool.run(1, [] (size_t) {});
+        }), std::logic_error);
+        thread_pool inner(2);
+        std::atomic<size_t> nested {0};
+        pool.run(4, [&] (size_t) {
+            inner.run(3, [&] (size_t) { ++nested; });
+        });
+        CHECK(nested == 12);
+    }
+}
+
+namespace {
+    template <typename Grid>
+    void check_evaluate (Grid const& g) {
+        auto f = [] (auto const& p) {
+            double r = std::hypot(p[0], p[1]);
+            int n = 0;
+            while (r > 1e-3 && n < 1000) {      // cost depends on the point
+                r *= 0.9;
+                ++n;
+            }
+            return p[0] * 3 + p[1] + n;
+        };
+        auto mapped = itadpt::map(g, f);
+        std::vector<double> serial(mapped.begin(), mapped.end());
+
+        for (size_t threads : {1, 3, 8}) {
+            thread_pool pool(threads);
+            for (size_t tile_size : {0, 1, 77}) {
+                std::vector<double> out(g.size());
+                evaluate(g, f, out, pool, tile_size);
+                // grid coordinates do not depend on the traversal, so
+                // neither do the results
+                CHECK(out == serial);
+            }
+        }
+
+        std::vector<double> out(g.size());
+        evaluate(g, f, out);
+        CHECK(out == serial);
+        std::vector<double> pointer_out(g.size());
+        thread_pool pool(2);
+        evaluate(g, f, pointer_out.data(), pool);
+        CHECK(pointer_out == serial);
+
+        std::vector<double> too_small(g.size() - 1);
+        CHECK_THROWS_AS(evaluate(g, f, too_small, pool), std::length_error);
+
+        // tiled traversal writes to the same positions
+        for (auto tile_shape : {std::array<size_t, 2> {1, 1},
+                                std::array<size_t, 2> {16, 16},
+                                std::array<size_t, 2> {7, 200}}) {
+            std::vector<double> tiled(g.size());
+            evaluate(g.tiles(tile_shape), f, tiled, pool);
+            CHECK(tiled == serial);
+        }
+        std::vector<double> tiled(g.size());
+        evaluate(g.tiles({32, 8}), f, tiled);
+        CHECK(tiled == serial);
+        CHECK_THROWS_AS(evaluate(g.tiles({8, 8}), f, too_small, pool), std::length_error);
+    }
+}
+
+TEST_CASE("evaluate-row-major") {
+    check_evaluate(grid<2> {{301, {-1, 1}}, {97, {-2, 0.5}}});
+}
+
+TEST_CASE("evaluate-col-major") {
+    check_evaluate(grid<2, major_order::col> {{301, {-1, 1}}, {97, {-2, 0.5}}});
+}
+
+TEST_CASE("evaluate-hilbert") {
+    grid<2, major_order::hilbert> g {{301, {-1, 1}}, {97, {-2, 0.5}}};
+    grid<2, major_order::col> gc {{301, {-1, 1}}, {97, {-2, 0.5}}};
+    auto f = [] (auto const& p) { return p[0] * 3 + p[1]; };
+    auto mapped = itadpt::map(g, f);
+    std::vector<double> serial(mapped.begin(), mapped.end());
+    for (size_t threads : {1, 3}) {
+        thread_pool pool(threads);
+        for (size_t tile_size : {0, 1, 77}) {
+            std::vector<double> out(g.size());
+            evaluate(g, f, out, pool, tile_size);
+            CHECK(out == serial);
+        }
+    }
+
+    // back in the order of the pixels
+    std::vector<double> col(gc.size());
+    evaluate(gc, f, col);
+    CHECK(deswizzle(g, serial) == col);
+}
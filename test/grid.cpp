@@ -17,9 +17,19 @@
 
 #define DOCTEST_CONFIG_IMPLEMENT_WITH_MAIN
 
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <iterator>
+#include <stdexcept>
+#include <tuple>
+#include <type_traits>
+#include <vector>
+
 #include <doctest/doctest.h>
 
 #include <colormap/grid.hpp>
+#include <colormap/itadpt/map_iterator_adapter.hpp>
 
 
 using namespace colormap;
@@ -88,3 +98,359 @@ TEST_CASE("ordering-col-major") {
         }
     }
 }
+
+template <typename G>
+void check_random_access () {
+    G g {{4, {0, 1}}, {3, {-1, 1}}, {5, {0, 10}}};
+    std::vector<typename G::grid_point_type> points(g.begin(), g.end());
+    REQUIRE(points.size() == g.size());
+    CHECK(g.end() - g.begin() == long(g.size()));
+    CHECK(std::distance(g.begin(), g.end()) == long(g.size()));
+
+    for (long i = 0; i <= long(g.size()); ++i) {
+        auto it = g.begin() + i;
+        CHECK(it - g.begin() == i);
+        CHECK(g.end() - it == long(g.size()) - i);
+        auto back = g.end() - (long(g.size()) - i);
+        CHECK(back == it);
+        if (i == long(g.size())) {
+            CHECK(it == g.end());
+            continue;
+        }
+        for (size_t k = 0; k < 3; ++k) {
+            CHECK((*it)[k] == doctest::Approx(points[i][k]));
+            CHECK(g.begin()[i][k] == doctest::Approx(points[i][k]));
+        }
+        auto stepped = it;
+        stepped += 7;
+        stepped -= 7;
+        CHECK(stepped == it);
+        if (i > 0) {
+            CHECK(--stepped == g.begin() + (i - 1));
+            for (size_t k = 0; k < 3; ++k)
+                CHECK((*stepped)[k] == doctest::Approx(points[i - 1][k]));
+        }
+        for (long j = 0; j <= long(g.size()); j += 5) {
+            auto other = g.begin() + j;
+            CHECK((it < other) == (i < j));
+            CHECK((it == other) == (i == j));
+            CHECK((it >= other) == (i >= j));
+        }
+    }
+
+    // stepping backwards from the end visits the points in reverse
+    auto back = g.end();
+    for (long i = long(g.size()); i-- > 0; ) {
+        auto p = *--back;
+        CHECK(back - g.begin() == i);
+        for (size_t k = 0; k < 3; ++k) {
+            CHECK(p[k] == doctest::Approx(points[i][k]));
+            CHECK((*std::prev(g.end(), long(g.size()) - i))[k] == doctest::Approx(points[i][k]));
+        }
+    }
+    auto rit = std::make_reverse_iterator(g.end());
+    for (long i = long(g.size()); i-- > 0; ++rit)
+        CHECK((*rit)[0] == doctest::Approx(points[i][0]));
+
+    // ... which carries over to mapped grids
+    auto sum = [] (auto const& p) { return p[0] + p[1] + p[2]; };
+    auto mapped = itadpt::map(g, sum);
+    CHECK(mapped.end() - mapped.begin() == long(g.size()));
+    CHECK(mapped.begin()[31] == doctest::Approx(sum(points[31])));
+
+    // moving along one dimension wraps around without carrying over
+    auto it = g.begin() + 17;
+    auto moved = it;
+    moved.template move_forward<1>();
+    for (size_t k = 0; k < 3; ++k)
+        CHECK((*(g.begin() + (moved - g.begin())))[k] == doctest::Approx((*moved)[k]));
+    moved.template move_backward<1>();
+    CHECK(moved == it);
+    for (int n = 0; n < 7; ++n)
+        moved.template move_forward<2>();
+    for (size_t k = 0; k < 3; ++k)
+        CHECK((*(g.begin() + (moved - g.begin())))[k] == doctest::Approx((*moved)[k]));
+
+    // moving backwards from the first point wraps around to the last one
+    auto wrapped = g.begin();
+    wrapped.template move_backward<0>();
+    CHECK(wrapped - g.begin() > 0);
+    CHECK(wrapped - g.begin() < long(g.size()));
+    wrapped.template move_forward<0>();
+    CHECK(wrapped == g.begin());
+}
+
+TEST_CASE("random-access-row-major") {
+    check_random_access<grid<3>>();
+}
+
+TEST_CASE("random-access-col-major") {
+    check_random_access<grid<3, major_order::col>>();
+}
+
+template <typename G>
+void check_tiling () {
+    G g {{4, {0, 1}}, {3, {-1, 1}}, {5, {0, 10}}};
+    for (auto tile_shape : {std::array<size_t, 3> {1, 1, 1},
+                            std::array<size_t, 3> {2, 2, 2},
+                            std::array<size_t, 3> {3, 1, 4},
+                            std::array<size_t, 3> {10, 10, 10}}) {
+        auto tiles = g.tiles(tile_shape);
+        size_t expected = 1;
+        for (size_t d = 0; d < 3; ++d) {
+            CHECK(tiles.count()[d] == (g.shape()[d] + tile_shape[d] - 1) / tile_shape[d]);
+            expected *= tiles.count()[d];
+        }
+        CHECK(tiles.size() == expected);
+        CHECK(tiles.end() - tiles.begin() == long(expected));
+        CHECK(tiles.points() == g.size());
+
+        // every point is visited exactly once and knows its position
+        std::vector<int> visits(g.size(), 0);
+        size_t tile_points = 0;
+        for (auto const& tile : tiles) {
+            size_t n = 0;
+            long last = -1;
+            for (auto it = tile.begin(); it != tile.end(); ++it, ++n) {
+                REQUIRE(it.index() < g.size());
+                ++visits[it.index()];
+                // within a tile, points come in the grid's major order
+                CHECK(long(it.index()) > last);
+                last = it.index();
+                auto p = g.begin()[it.index()];
+                for (size_t k = 0; k < 3; ++k)
+                    CHECK((*it)[k] == p[k]);
+            }
+            CHECK(n == tile.size());
+            tile_points += n;
+            for (size_t d = 0; d < 3; ++d) {
+                CHECK(tile.origin()[d] % tile_shape[d] == 0);
+                CHECK(tile.shape()[d] == std::min(tile_shape[d],
+                                                  g.shape()[d] - tile.origin()[d]));
+            }
+        }
+        CHECK(tile_points == g.size());
+        CHECK(std::all_of(visits.begin(), visits.end(), [] (int v) { return v == 1; }));
+
+        // the first point of successive tiles follows the major order of
+        // the tiles themselves
+        for (size_t k = 1; k < tiles.size(); ++k) {
+            auto prev = tiles[k - 1].origin();
+            auto next = tiles[k].origin();
+            if (std::is_same<G, grid<3, major_order::col>>::value) {
+                std::reverse(prev.begin(), prev.end());
+                std::reverse(next.begin(), next.end());
+            }
+            CHECK(prev < next);
+        }
+    }
+
+    CHECK_THROWS_AS(g.tiles({2, 0, 2}), std::runtime_error);
+}
+
+TEST_CASE("tiling-row-major") {
+    check_tiling<grid<3>>();
+}
+
+TEST_CASE("tiling-col-major") {
+    check_tiling<grid<3, major_order::col>>();
+}
+
+TEST_CASE("bit-interleave") {
+    for (std::uint64_t x : {0ull, 1ull, 0x2aull, 0x1fffffull, 0x155555ull}) {
+        std::uint64_t spread2 = 0, spread3 = 0;
+        for (unsigned b = 0; b < 21; ++b) {
+            spread2 |= ((x >> b) & 1) << (2 * b);
+            spread3 |= ((x >> b) & 1) << (3 * b);
+        }
+        CHECK(detail::bit_interleave<2>::spread(x) == spread2);
+        CHECK(detail::bit_interleave<3>::spread(x) == spread3);
+        CHECK(detail::bit_interleave<2>::compact(spread2) == x);
+        CHECK(detail::bit_interleave<3>::compact(spread3) == x);
+    }
+    CHECK(detail::bit_interleave<2>::spread(0xffffffffull) == 0x5555555555555555ull);
+    CHECK(detail::bit_interleave<2>::compact(~0ull) == 0xffffffffull);
+}
+
+TEST_CASE("morton-order") {
+    grid<2, major_order::morton> g {{4, {0, 3}}, {4, {0, 3}}};
+    std::vector<std::array<size_t, 2>> expected {
+        {0, 0}, {1, 0}, {0, 1}, {1, 1}, {2, 0}, {3, 0}, {2, 1}, {3, 1},
+        {0, 2}, {1, 2}, {0, 3}, {1, 3}, {2, 2}, {3, 2}, {2, 3}, {3, 3}};
+    size_t i = 0;
+    for (auto it = g.begin(); it != g.end(); ++it, ++i) {
+        REQUIRE(i < expected.size());
+        CHECK(it.indices() == expected[i]);
+        CHECK((*it)[0] == double(expected[i][0]));
+        CHECK((*it)[1] == double(expected[i][1]));
+    }
+    CHECK(i == expected.size());
+}
+
+template <size_t n>
+void check_hilbert_adjacency (unsigned bits) {
+    using curve = detail::hilbert_curve<n>;
+    const std::uint64_t size = std::uint64_t(1) << (n * bits);
+    auto prev = curve::decode(0, bits);
+    CHECK(prev == detail::curve_point<n>{});
+    for (std::uint64_t c = 1; c < size; ++c) {
+        auto x = curve::decode(c, bits);
+        CHECK(curve::encode(x, bits) == c);
+        unsigned dist = 0;
+        for (size_t k = 0; k < n; ++k)
+            dist += x[k] > prev[k] ? x[k] - prev[k] : prev[k] - x[k];
+        CHECK(dist == 1);
+        prev = x;
+    }
+}
+
+TEST_CASE("hilbert-adjacency") {
+    for (unsigned bits : {1, 2, 5})
+        check_hilbert_adjacency<2>(bits);
+    for (unsigned bits : {1, 3})
+        check_hilbert_adjacency<3>(bits);
+}
+
+template <typename G>
+void check_curve (G const& g) {
+    using point = typename G::grid_point_type;
+    const size_t dim = std::tuple_size<point>::value;
+    auto shape = g.shape();
+
+    // every point is visited exactly once
+    std::vector<std::array<size_t, dim>> seq;
+    for (auto it = g.begin(); it != g.end(); ++it)
+        seq.push_back(it.indices());
+    REQUIRE(seq.size() == g.size());
+    auto sorted = seq;
+    std::sort(sorted.begin(), sorted.end());
+    CHECK(std::adjacent_find(sorted.begin(), sorted.end()) == sorted.end());
+    for (auto const& idx : seq)
+        for (size_t d = 0; d < dim; ++d)
+            CHECK(idx[d] < shape[d]);
+
+    // random access and stepping backwards agree with stepping forwards
+    CHECK(g.end() - g.begin() == long(g.size()));
+    auto back = g.end();
+    for (long i = long(g.size()); i-- > 0; ) {
+        --back;
+        CHECK(back - g.begin() == i);
+        CHECK(back.indices() == seq[i]);
+        CHECK((g.begin() + i).indices() == seq[i]);
+    }
+    CHECK(back == g.begin());
+
+    // moving along a dimension lands at the right position in the sequence
+    for (long i : {0L, 5L, long(g.size()) - 1}) {
+        for (int d = 0; d < 2; ++d) {
+            auto it = g.begin() + i;
+            if (d == 0)
+                it.template move_forward<0>();
+            else
+                it.template move_backward<1>();
+            CHECK(seq[it - g.begin()] == it.indices());
+            auto p = *it;
+            auto q = *(g.begin() + (it - g.begin()));
+            CHECK(p == q);
+        }
+    }
+
+    // deswizzling into column- and row-major order
+    auto label = [&] (std::array<size_t, dim> const& idx) {
+        size_t l = 0;
+        for (size_t d = 0; d < dim; ++d)
+            l = l * 100 + idx[d];
+        return l;
+    };
+    std::vector<size_t> labels;
+    for (auto const& idx : seq)
+        labels.push_back(label(idx));
+    auto col = deswizzle(g, labels);
+    auto row = deswizzle<major_order::row>(g, labels);
+    std::array<size_t, dim> idx {};
+    for (size_t f = 0; f < g.size(); ++f) {
+        CHECK(col[f] == label(idx));
+        for (size_t d = 0; d < dim && ++idx[d] == shape[d]; ++d)
+            idx[d] = 0;
+    }
+    for (size_t f = 0; f < g.size(); ++f) {
+        CHECK(row[f] == label(idx));
+        for (size_t d = dim; d-- > 0 && ++idx[d] == shape[d]; )
+            idx[d] = 0;
+    }
+    std::vector<size_t> too_few(g.size() - 1);
+    CHECK_THROWS_AS(deswizzle(g, too_few), std::length_error);
+}
+
+TEST_CASE("curve-order-2d") {
+    check_curve(grid<2, major_order::morton> {{13, {0, 1}}, {6, {-1, 1}}});
+    check_curve(grid<2, major_order::hilbert> {{13, {0, 1}}, {6, {-1, 1}}});
+    check_curve(grid<2, major_order::hilbert> {{2, {0, 1}}, {70, {-1, 1}}});
+    check_curve(grid<2, major_order::hilbert> {{16, {0, 1}}, {16, {-1, 1}}});
+}
+
+TEST_CASE("curve-order-3d") {
+    check_curve(grid<3, major_order::morton> {{5, {0, 1}}, {3, {-1, 1}}, {7, {0, 10}}});
+    check_curve(grid<3, major_order::hilbert> {{5, {0, 1}}, {3, {-1, 1}}, {7, {0, 10}}});
+    check_curve(grid<3, major_order::hilbert> {{2, {0, 1}}, {2, {-1, 1}}, {33, {0, 10}}});
+}
+
+template <size_t W, typename G>
+void check_batches (G const& g) {
+    const size_t dim = std::tuple_size<typename G::grid_point_type>::value;
+    size_t next = 0;
+    g.template for_each_batch<W>([&] (auto const& batch) {
+        CHECK(batch.width == W);
+        CHECK(batch.index() == next);
+        REQUIRE(batch.size() > 0);
+        REQUIRE(batch.size() <= W);
+        CHECK(batch.mask() == (std::uint64_t(1) << batch.size()) - 1);
+        for (size_t l = 0; l < W; ++l) {
+            // coordinates match those of the iterators exactly; idle lanes
+            // repeat the last point
+            auto p = g.begin()[batch.index() + std::min(l, batch.size() - 1)];
+            for (size_t k = 0; k < dim; ++k)
+                CHECK(batch[k][l] == p[k]);
+        }
+        next += batch.size();
+    });
+    CHECK(next == g.size());
+}
+
+template <size_t W, typename T>
+void check_batches (grid<1, major_order::row, T> const& g) {
+    size_t next = 0;
+    g.template for_each_batch<W>([&] (auto const& batch) {
+        CHECK(batch.index() == next);
+        for (size_t l = 0; l < W; ++l)
+            CHECK(batch[0][l] == *(g.begin() + (batch.index() + std::min(l, batch.size() - 1))));
+        next += batch.size();
+    });
+    CHECK(next == g.size());
+}
+
+TEST_CASE("batches") {
+    grid<2> row {{7, {0, 1}}, {13, {-1, 1}}};
+    grid<2, major_order::col> col {{13, {-2.5, 1}}, {7, {-1, 1}}};
+    grid<3, major_order::col> col3 {{4, {0, 1}}, {3, {-1, 1}}, {5, {0, 10}}};
+    grid<2, major_order::hilbert> hilbert {{13, {0, 1}}, {6, {-1, 1}}};
+    grid<1> line {42, {0, 10}};
+
+    check_batches<1>(row);
+    check_batches<4>(row);
+    check_batches<16>(row);
+    check_batches<4>(col);
+    check_batches<8>(col);
+    check_batches<8>(col3);
+    check_batches<4>(hilbert);
+    check_batches<16>(hilbert);
+    check_batches<4>(line);
+    check_batches<16>(line);
+
+    // in row- and column-major order, batches stay within a row
+    col.for_each_batch<8>([] (auto const& batch) {
+        CHECK(batch.index() % 13 + batch.size() <= 13);
+        CHECK(std::all_of(batch[1], batch[1] + 8,
+                          [&] (double y) { return y == batch[1][0]; }));
+    });
+}
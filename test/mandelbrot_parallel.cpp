@@ -0,0 +1,84 @@
+// colormap -- color palettes, map iterators, grids, and PPM export
+// Copyright (C) 2018-2019  Jonas Greitemann
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+#include <algorithm>
+#include <cmath>
+#include <complex>
+#include <fstream>
+#include <iostream>
+#include <vector>
+
+#include <colormap/color.hpp>
+#include <colormap/evaluate.hpp>
+#include <colormap/grid.hpp>
+#include <colormap/palettes.hpp>
+#include <colormap/pixmap.hpp>
+#include <colormap/thread_pool.hpp>
+#include <colormap/itadpt/map_iterator_adapter.hpp>
+
+
+using namespace colormap;
+
+// The mandelbrot example, with the function values computed in parallel.
+int main () {
+    grid<2, major_order::col> g { {701, {-2.5, 1.}}, {401, {-1., 1.}} };
+    using grid_point_t = typename decltype(g)::grid_point_type;
+
+    auto mandelbrot = [] (grid_point_t c_arr) {
+        const size_t max_it = 1000;
+        const double bail_out = std::pow(2, 16);
+
+        auto func = [] (double x) { return pow(x, 0.1); };
+
+        std::complex<double> c { c_arr[0], c_arr[1] };
+        std::complex<double> z = 0.;
+        size_t it;
+        for (it = 0; it < max_it && std::norm(z) < bail_out; ++it)
+            z = z * z + c;
+        if (it < max_it) {
+            double log2_z = log(std::norm(z)) * 0.5 / log(2);
+            double nu = log(log2_z) / log(2);
+            return func(it + 1 - nu);
+        } else {
+            return 0.;
+        }
+    };
+
+    // Evaluate the functor on all grid points in parallel. The cost per point
+    // varies wildly between the interior and the exterior of the set, which
+    // the thread pool balances by work stealing.
+    std::vector<double> val(g.size());
+    thread_pool pool;
+    evaluate(g, mandelbrot, val, pool);
+
+    // the grid coordinates do not depend on the order of traversal, so the
+    // values are the same as when evaluated one after the other
+    auto val_map = itadpt::map(g, mandelbrot);
+    if (!std::equal(val.begin(), val.end(), val_map.begin())) {
+        std::cerr << "parallel evaluation differs from serial one" << std::endl;
+        return 1;
+    }
+
+    double max = *std::max_element(val.begin(), val.end());
+    auto pal = palettes.at("inferno").rescale(1, max);
+    auto pix = itadpt::map(val, pal);
+    pixmap<decltype(pix.begin())> pmap(pix.begin(), g.shape());
+
+    std::ofstream os("appleman_parallel." + pmap.file_extension(),
+                     std::ios_base::binary);
+    pmap.write_binary(os);
+}
@@ -0,0 +1,398 @@
+// colormap -- color palettes, map iterators, grids, and PPM export
+// Copyright (C) 2018-2019  Jonas Greitemann
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+#define DOCTEST_CONFIG_IMPLEMENT_WITH_MAIN
+
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <iterator>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include <doctest/doctest.h>
+
+#include <colormap/map.hpp>
+#include <colormap/palettes.hpp>
+
+
+using namespace colormap;
+
+namespace {
+    using rgb = color<space::rgb>;
+
+    int max_channel_diff (rgb const& a, rgb const& b) {
+        int diff = 0;
+        diff = std::max(diff, std::abs(a.getRed().getValue() - b.getRed().getValue()));
+        diff = std::max(diff, std::abs(a.getGreen().getValue() - b.getGreen().getValue()));
+        diff = std::max(diff, std::abs(a.getBlue().getValue() - b.getBlue().getValue()));
+        return diff;
+    }
+}
+
+TEST_CASE("baked-map") {
+    auto pal = palettes.at("inferno").rescale(-3., 5.);
+    auto baked = pal.bake(4096);
+    CHECK(baked.size() == 4096);
+    for (double x = -3.; x <= 5.; x += 1e-3)
+        CHECK(max_channel_diff(pal(x), baked(x)) <= 1);
+    CHECK(max_channel_diff(pal(-3.), baked(-10.)) == 0);
+    CHECK(max_channel_diff(pal(5.), baked(10.)) == 0);
+}
+
+TEST_CASE("baked-map-rescale") {
+    auto pal = palettes.at("viridis");
+    auto baked = pal.bake(1024).rescale(10., 20.);
+    auto rescaled = pal.rescale(10., 20.);
+    for (double x = 10.; x <= 20.; x += 1e-2)
+        CHECK(max_channel_diff(rescaled(x), baked(x)) <= 1);
+}
+
+TEST_CASE("non-uniform-supports") {
+    map<rgb> pal {
+        {0., rgb {0, 0, 0}},
+        {3., rgb {30, 60, 90}},
+        {1., rgb {10, 20, 30}},
+        {4., rgb {200, 200, 200}},
+    };
+    CHECK(max_channel_diff(pal(-1.), rgb {0, 0, 0}) == 0);
+    CHECK(max_channel_diff(pal(0.25), rgb {10, 20, 30}) == 0);
+    CHECK(max_channel_diff(pal(0.5), rgb {20, 40, 60}) == 0);
+    CHECK(max_channel_diff(pal(0.75), rgb {30, 60, 90}) == 0);
+    CHECK(max_channel_diff(pal(1.), rgb {200, 200, 200}) == 0);
+    CHECK(max_channel_diff(pal(2.), rgb {200, 200, 200}) == 0);
+}
+
+TEST_CASE("batch-apply") {
+    std::vector<double> xs;
+    for (int i = -100; i <= 1100; ++i)
+        xs.push_back(i / 1000.);
+    for (int i = 0; i <= 255; ++i) {
+        xs.push_back(i / 255.);
+        xs.push_back(std::nextafter(i / 255., 2.));
+        xs.push_back(std::nextafter(i / 255., -2.));
+    }
+    xs.push_back(std::numeric_limits<double>::quiet_NaN());
+    xs.push_back(std::numeric_limits<double>::infinity());
+    xs.push_back(-std::numeric_limits<double>::infinity());
+    std::vector<float> fs(xs.begin(), xs.end());
+
+    map<rgb> non_uniform {
+        {0., rgb {0, 0, 0}},
+        {0.3, rgb {30, 60, 90}},
+        {0.35, rgb {10, 20, 30}},
+        {1., rgb {200, 200, 200}},
+    };
+    for (auto const& pal : {palettes.at("inferno"), palettes.at("accent"),
+                            palettes.at("jet").rescale(0.2, 0.7), non_uniform}) {
+        std::vector<rgb> out(xs.size());
+        pal.apply(xs, out);
+        for (size_t i = 0; i < xs.size(); ++i)
+            CHECK(max_channel_diff(out[i], pal(xs[i])) == 0);
+        pal.apply(fs.data(), out.data(), fs.size());
+        for (size_t i = 0; i < fs.size(); ++i)
+            CHECK(max_channel_diff(out[i], pal(fs[i])) == 0);
+    }
+
+    using rgba16 = color<space::rgba, std::uint16_t>;
+    map<rgba16> deep {
+        rgba16 {0, 65535, 100, 65535},
+        rgba16 {65535, 0, 200, 0},
+        rgba16 {1234, 4321, 300, 32768},
+    };
+    std::vector<rgba16> deep_out(xs.size());
+    deep.apply(xs, deep_out);
+    for (size_t i = 0; i < xs.size(); ++i)
+        for (size_t k = 0; k < 4; ++k)
+            CHECK(deep_out[i].getChannel(k).getValue()
+                  == deep(xs[i]).getChannel(k).getValue());
+
+    std::vector<color<space::grayscale>> gray_out(xs.size());
+    grayscale.apply(xs, gray_out);
+    for (size_t i = 0; i < xs.size(); ++i)
+        CHECK(gray_out[i].getValue() == grayscale(xs[i]).getValue());
+}
+
+TEST_CASE("palette-registry") {
+    CHECK(palettes.size() == 49);
+    CHECK(palettes.count("viridis") == 1);
+    CHECK(palettes.count("nonexistent") == 0);
+    CHECK(palettes.find("nonexistent") == palettes.end());
+    CHECK_THROWS_AS(palettes.at("nonexistent"), std::out_of_range);
+    // palettes are constructed once and shared
+    CHECK(&palettes.at("magma") == &palettes.at("magma"));
+    CHECK(&(*palettes.find("magma")).second == &palettes.at("magma"));
+    CHECK(&palettes.find("magma")->second == &palettes.at("magma"));
+    CHECK(palettes.find("magma")->first == "magma");
+    size_t n = 0;
+    for (auto const& pair : palettes) {
+        CHECK(&pair.second == &palettes.at(pair.first));
+        ++n;
+    }
+    CHECK(n == palettes.size());
+
+    // iterators yield real references to the shared entries
+    using iterator = decltype(palettes.begin());
+    using traits = std::iterator_traits<iterator>;
+    static_assert(std::is_same<traits::reference, traits::value_type const&>::value,
+                  "registry iterators return references to the entries");
+    static_assert(std::is_same<decltype(palettes.begin().operator->()),
+                               traits::value_type const *>::value,
+                  "registry iterators return pointers to the entries");
+    CHECK(&*palettes.begin() == palettes.begin().operator->());
+
+    static_assert(std::is_same<decltype(grayscale), const map<color<space::grayscale>>>::value,
+                  "grayscale keeps its type");
+    map<color<space::grayscale>> const& gray_ref = grayscale;
+    CHECK(grayscale(0.5).getValue() == 128);
+    CHECK(gray_ref(1.).getValue() == 255);
+}
+
+TEST_CASE("palette-ids") {
+    // table views are resolved at compile time
+    static_assert(get<palette::inferno>().size == 256, "inferno has 256 colors");
+    static_assert(detail::str_length(get<palette::ylrd>().name) == 4, "ylrd is named");
+    CHECK(std::string(get<palette::ylrd>().name) == "ylrd");
+    CHECK(get<palette::rdwhbu>().supports != nullptr);
+    size_t i = 0;
+    for (auto const& pair : palettes) {
+        CHECK(palette_data::tables[i].name == pair.first);
+        CHECK(&palettes.at(palette(i)) == &pair.second);
+        ++i;
+    }
+    CHECK(max_channel_diff(get<palette::inferno>().to_map()(0.3),
+                           palettes.at("inferno")(0.3)) == 0);
+    CHECK(&get_baked<palette::viridis>() == &get_baked<palette::viridis>());
+    CHECK(max_channel_diff(get_baked<palette::viridis>()(0.3),
+                           palettes.at(palette::viridis)(0.3)) <= 1);
+    for (auto const& pair : palettes)
+        CHECK(palettes.count(pair.first) == 1);
+    for (std::string name : {"", "infern", "infernoo", "Inferno"})
+        CHECK(palettes.count(name) == 0);
+    CHECK(palettes.count(std::string("jet\0", 4)) == 0);
+}
+
+TEST_CASE("palette-names-with-nul") {
+    // names which extend a palette's name past an embedded NUL and hash to
+    // the same slot of the name index
+    auto const& index = detail::builtin_palette_index<>::value;
+    size_t tried = 0;
+    for (auto const& pair : palettes) {
+        std::string const name = pair.first;
+        auto slot = [&] (std::string const& s) {
+            return detail::name_hash(s.data(), s.size(), index.seed)
+                % detail::name_index::slot_count;
+        };
+        for (unsigned k = 0; k < 65536; ++k) {
+            std::string other = name + '\0' + char(k & 0xff) + char(k >> 8);
+            if (slot(other) != slot(name))
+                continue;
+            CHECK(palettes.count(other) == 0);
+            ++tried;
+            break;
+        }
+    }
+    CHECK(tried == palettes.size());
+}
+
+TEST_CASE("lut-map") {
+    auto const& pal = palettes.at("viridis");
+    auto lut8 = pal.rescale(0., 255.).as_lut<std::uint8_t>();
+    CHECK(lut8.size() == 256);
+    for (int c = 0; c < 256; ++c)
+        CHECK(max_channel_diff(lut8(c), pal(c / 255.)) == 0);
+
+    // 12-bit detector counts stored in 16-bit words
+    auto lut12 = pal.rescale(0., 4095.).as_lut<std::uint16_t>(0, 4095);
+    CHECK(lut12.size() == 4096);
+    CHECK(lut12.code_range() == std::make_pair<std::uint16_t, std::uint16_t>(0, 4095));
+    std::vector<std::uint16_t> counts;
+    for (int c = 0; c < 5000; c += 3)
+        counts.push_back(c);
+    counts.push_back(65535);
+    std::vector<rgb> out(counts.size());
+    lut12.apply(counts, out);
+    for (size_t i = 0; i < counts.size(); ++i) {
+        double x = std::min<double>(counts[i], 4095.);
+        CHECK(max_channel_diff(out[i], pal(x / 4095.)) == 0);
+    }
+
+    auto signed_lut = pal.rescale(-100., 100.).as_lut<std::int16_t>(-100, 100);
+    std::vector<std::int16_t> heights {-32768, -101, -100, -1, 0, 1, 50, 99,
+                                       100, 101, 32767, 7, -7};
+    std::vector<rgb> heights_out(heights.size());
+    signed_lut.apply(heights, heights_out);
+    for (size_t i = 0; i < heights.size(); ++i) {
+        double x = std::max(-100., std::min(100., double(heights[i])));
+        CHECK(max_channel_diff(heights_out[i], pal((x + 100.) / 200.)) == 0);
+    }
+
+    using rgba = color<space::rgba>;
+    map<rgba> translucent {rgba {0, 0, 0, 0}, rgba {255, 128, 64, 255}};
+    auto rgba_lut = translucent.rescale(-128., 127.).as_lut<std::int8_t>();
+    std::vector<std::int8_t> codes;
+    for (int c = -128; c < 128; ++c)
+        codes.push_back(c);
+    std::vector<rgba> rgba_out(codes.size());
+    rgba_lut.apply(codes, rgba_out);
+    for (size_t i = 0; i < codes.size(); ++i)
+        for (size_t k = 0; k < 4; ++k)
+            CHECK(rgba_out[i].getChannel(k).getValue()
+                  == translucent((codes[i] + 128) / 255.).getChannel(k).getValue());
+
+    CHECK_THROWS_AS(pal.as_lut<std::uint8_t>(10, 5), std::runtime_error);
+}
+
+TEST_CASE("inverse-map") {
+    for (auto name : {"inferno", "viridis", "jet"}) {
+        auto pal = palettes.at(name).rescale(-2., 6.);
+        auto inv = pal.inverse();
+        std::vector<rgb> colors;
+        for (double x = -2.; x <= 6.; x += 1e-3)
+            colors.push_back(pal(x));
+        std::vector<double> xs(colors.size());
+        inv.apply(colors, xs);
+        for (size_t i = 0; i < colors.size(); ++i) {
+            CHECK(xs[i] == inv(colors[i]));
+            // the recovered value reproduces the color up to rounding
+            CHECK(max_channel_diff(pal(xs[i]), colors[i]) <= 1);
+        }
+    }
+
+    // arbitrary colors agree with a brute-force search over all segments
+    auto const& pal = palettes.at("viridis");
+    auto inv = pal.inverse();
+    std::vector<rgb> supports;
+    for (int i = 0; i < 256; ++i)
+        supports.push_back(pal(i / 255.));
+    std::srand(42);
+    for (int trial = 0; trial < 2000; ++trial) {
+        double q[3] = {double(std::rand() % 256), double(std::rand() % 256),
+                       double(std::rand() % 256)};
+        double best = std::numeric_limits<double>::infinity();
+        for (size_t i = 0; i + 1 < supports.size(); ++i) {
+            double o[3] = {double(supports[i].getRed().getValue()),
+                           double(supports[i].getGreen().getValue()),
+                           double(supports[i].getBlue().getValue())};
+            double d[3] = {supports[i+1].getRed().getValue() - o[0],
+                           supports[i+1].getGreen().getValue() - o[1],
+                           supports[i+1].getBlue().getValue() - o[2]};
+            double len2 = d[0] * d[0] + d[1] * d[1] + d[2] * d[2];
+            double t = ((q[0] - o[0]) * d[0] + (q[1] - o[1]) * d[1]
+                        + (q[2] - o[2]) * d[2]) / len2;
+            t = std::max(0., std::min(1., t));
+            double dist = 0.;
+            for (int k = 0; k < 3; ++k)
+                dist += (q[k] - o[k] - t * d[k]) * (q[k] - o[k] - t * d[k]);
+            best = std::min(best, dist);
+        }
+        rgb c {std::uint8_t(q[0]), std::uint8_t(q[1]), std::uint8_t(q[2])};
+        rgb back = pal(inv(c));
+        double found = 0.;
+        found += std::pow(back.getRed().getValue() - q[0], 2);
+        found += std::pow(back.getGreen().getValue() - q[1], 2);
+        found += std::pow(back.getBlue().getValue() - q[2], 2);
+        // pal(x) is rounded to integer channels
+        CHECK(std::sqrt(found) <= std::sqrt(best) + 1.);
+    }
+
+    map<color<space::grayscale>> ramp {
+        {0., color<space::grayscale> {0}},
+        {10., color<space::grayscale> {255}},
+    };
+    auto ramp_inv = ramp.rescale(0., 10.).inverse();
+    CHECK(ramp_inv(color<space::grayscale> {0}) == 0.);
+    CHECK(ramp_inv(color<space::grayscale> {255}) == 10.);
+    CHECK(std::abs(ramp_inv(color<space::grayscale> {51}) - 2.) < 1e-12);
+}
+
+TEST_CASE("categorical-map") {
+    auto set1 = palettes.at("set1").categorical();
+    int n = set1.size();
+    CHECK(set1.policy() == category_policy::wrap);
+    for (int i = 0; i < n; ++i)
+        CHECK(max_channel_diff(set1(i), palettes.at("set1")(i / (n - 1.))) == 0);
+    CHECK(max_channel_diff(set1(n), set1(0)) == 0);
+    CHECK(max_channel_diff(set1(-1), set1(n - 1)) == 0);
+
+    std::vector<std::int32_t> labels;
+    for (int i = -40; i < 40; ++i)
+        labels.push_back(i * 7919);
+    labels.push_back(std::numeric_limits<std::int32_t>::min());
+    labels.push_back(std::numeric_limits<std::int32_t>::max());
+    std::vector<std::uint32_t> ulabels(labels.begin(), labels.end());
+    std::vector<std::uint16_t> shorts(labels.begin(), labels.end());
+    std::vector<std::int8_t> bytes(labels.begin(), labels.end());
+
+    for (auto policy : {category_policy::wrap, category_policy::clamp}) {
+        categorical_map<rgb> cats {{rgb {1, 2, 3}, rgb {4, 5, 6}, rgb {7, 8, 9}}, policy};
+        auto expected = [&] (std::int64_t label) {
+            std::int64_t i = policy == category_policy::wrap
+                ? ((label % 3) + 3) % 3
+                : std::max<std::int64_t>(0, std::min<std::int64_t>(2, label));
+            return cats.colors()[i];
+        };
+        std::vector<rgb> out(labels.size());
+        std::vector<std::uint8_t> indices(labels.size());
+
+        cats.apply(labels, out);
+        for (size_t i = 0; i < labels.size(); ++i)
+            CHECK(max_channel_diff(out[i], expected(labels[i])) == 0);
+        cats.apply(ulabels, out);
+        for (size_t i = 0; i < labels.size(); ++i)
+            CHECK(max_channel_diff(out[i], expected(ulabels[i])) == 0);
+        cats.apply(shorts, out);
+        for (size_t i = 0; i < labels.size(); ++i)
+            CHECK(max_channel_diff(out[i], expected(shorts[i])) == 0);
+        cats.apply(bytes, out);
+        for (size_t i = 0; i < labels.size(); ++i)
+            CHECK(max_channel_diff(out[i], expected(bytes[i])) == 0);
+
+        cats.apply_indices(labels, indices);
+        for (size_t i = 0; i < labels.size(); ++i)
+            CHECK(max_channel_diff(cats.colors()[indices[i]], expected(labels[i])) == 0);
+        cats.apply_indices(ulabels, indices);
+        for (size_t i = 0; i < labels.size(); ++i)
+            CHECK(max_channel_diff(cats.colors()[indices[i]], expected(ulabels[i])) == 0);
+
+        // unsigned 64-bit labels above 2^63 are large, not negative
+        const std::uint64_t top = std::numeric_limits<std::uint64_t>::max();
+        std::vector<std::uint64_t> huge {top, top - 1, top - 2,
+                                         std::uint64_t(1) << 63, (std::uint64_t(1) << 63) + 1};
+        std::vector<rgb> huge_out(huge.size());
+        cats.apply(huge, huge_out);
+        for (size_t i = 0; i < huge.size(); ++i) {
+            size_t k = policy == category_policy::wrap ? size_t(huge[i] % 3) : 2;
+            CHECK(cats.index(huge[i]) == k);
+            CHECK(max_channel_diff(cats(huge[i]), cats.colors()[k]) == 0);
+            CHECK(max_channel_diff(huge_out[i], cats.colors()[k]) == 0);
+        }
+    }
+    std::vector<rgb> none;
+    CHECK_THROWS_AS(categorical_map<rgb>(none.begin(), none.end()), std::runtime_error);
+    CHECK_THROWS_AS(detail::category_index(5, 0, true), std::out_of_range);
+
+    using rgba = color<space::rgba>;
+    categorical_map<rgba> translucent {rgba {0, 0, 0, 0}, rgba {9, 8, 7, 6}};
+    std::vector<rgba> rgba_out(labels.size());
+    translucent.apply(labels, rgba_out);
+    for (size_t i = 0; i < labels.size(); ++i)
+        CHECK(rgba_out[i].getAlpha().getValue() == (labels[i] % 2 ? 6 : 0));
+}
@@ -0,0 +1,638 @@
+// colormap -- color palettes, map iterators, grids, and PPM export
+// Copyright (C) 2018-2019  Jonas Greitemann
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+#define DOCTEST_CONFIG_IMPLEMENT_WITH_MAIN
+
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+#include <list>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <doctest/doctest.h>
+
+#include <colormap/async_pixmap_writer.hpp>
+#include <colormap/direct_pixmap_writer.hpp>
+#include <colormap/map.hpp>
+#include <colormap/palettes.hpp>
+#include <colormap/pixmap.hpp>
+#include <colormap/png.hpp>
+#include <colormap/itadpt/map_iterator_adapter.hpp>
+
+
+using namespace colormap;
+
+namespace {
+    using rgb = color<space::rgb>;
+
+    // an image whose pixels are only accessible through a mapped iterator
+    struct scene {
+        scene (size_t width, size_t height)
+            : shape(width, height), values(width * height)
+        {
+            for (size_t i = 0; i < values.size(); ++i)
+                values[i] = double(i % width) / width + double(i / width) / height;
+            frame.resize(values.size());
+            palette.apply(values, frame);
+        }
+
+        template <typename Pixmap>
+        static std::string binary (Pixmap const& pmap) {
+            std::ostringstream os;
+            pmap.write_binary(os);
+            return os.str();
+        }
+
+        static std::string read_file (std::string const& path) {
+            std::ifstream is(path, std::ios_base::binary);
+            std::string content {std::istreambuf_iterator<char>(is),
+                                 std::istreambuf_iterator<char>()};
+            std::remove(path.c_str());
+            return content;
+        }
+
+        std::string reference () const {
+            std::ostringstream os;
+            os << "P6\n" << shape.first << ' ' << shape.second << "\n255\n";
+            for (auto const& pix : frame)
+                pix.write(os);
+            return os.str();
+        }
+
+        std::pair<size_t, size_t> shape;
+        std::vector<double> values;
+        std::vector<rgb> frame;
+        map<rgb> palette = palettes.at("viridis").rescale(0., 2.);
+    };
+}
+
+TEST_CASE("write-binary") {
+    for (auto shape : {std::make_pair(1, 1), std::make_pair(37, 5),
+                       std::make_pair(3000, 40), std::make_pair(0, 3)}) {
+        scene s(shape.first, shape.second);
+        auto mapped = itadpt::map(s.values, s.palette);
+        pixmap<decltype(mapped.begin())> buffered(mapped.begin(), s.shape);
+        pixmap<std::vector<rgb>::const_iterator> from_vector(s.frame.cbegin(), s.shape);
+        pixmap<rgb const *> from_pointer(s.frame.data(), s.shape);
+        CHECK(scene::binary(buffered) == s.reference());
+        CHECK(scene::binary(from_vector) == s.reference());
+        CHECK(scene::binary(from_pointer) == s.reference());
+    }
+    CHECK(detail::is_packed_contiguous<rgb const *>::value);
+    CHECK(detail::is_packed_contiguous<std::vector<rgb>::iterator>::value);
+    CHECK_FALSE(detail::is_packed_contiguous<std::vector<color<space::rgb, std::uint16_t>>::iterator>::value);
+}
+
+TEST_CASE("write-mmap") {
+    for (auto shape : {std::make_pair(1, 1), std::make_pair(37, 5),
+                       std::make_pair(3000, 40), std::make_pair(0, 3)}) {
+        scene s(shape.first, shape.second);
+        std::string path = "write-mmap.ppm";
+
+        auto mapped = itadpt::map(s.values, s.palette);
+        pixmap<decltype(mapped.begin())> from_values(mapped.begin(), s.shape);
+        for (size_t threads : {0, 1, 3, 64}) {
+            from_values.write_mmap(path, threads);
+            CHECK(scene::read_file(path) == s.reference());
+        }
+
+        pixmap<rgb const *> from_pointer(s.frame.data(), s.shape);
+        from_pointer.write_mmap(path, 4);
+        CHECK(scene::read_file(path) == s.reference());
+
+        std::list<rgb> forward_only(s.frame.begin(), s.frame.end());
+        pixmap<std::list<rgb>::const_iterator> from_list(forward_only.cbegin(), s.shape);
+        from_list.write_mmap(path);
+        CHECK(scene::read_file(path) == s.reference());
+    }
+    scene s(4, 4);
+    pixmap<rgb const *> pmap(s.frame.data(), s.shape);
+    CHECK_THROWS_AS(pmap.write_mmap("nonexistent-dir/out.ppm"), std::runtime_error);
+}
+
+TEST_CASE("write-ascii") {
+    using gray16 = color<space::grayscale, std::uint16_t>;
+    std::vector<gray16> deep;
+    for (std::uint32_t v = 0; v < 65536; v += 97)
+        deep.push_back(gray16 {std::uint16_t(v)});
+    deep.push_back(gray16 {65535});
+
+    for (auto shape : {std::make_pair(1, 1), std::make_pair(37, 5), std::make_pair(300, 40)}) {
+        scene s(shape.first, shape.second);
+        pixmap<rgb const *> pmap(s.frame.data(), s.shape);
+        std::ostringstream os;
+        pmap.write_ascii(os);
+
+        std::istringstream is(os.str());
+        std::string line;
+        std::getline(is, line);
+        CHECK(line == "P3");
+        size_t width, height, depth;
+        is >> width >> height >> depth;
+        CHECK(width == s.shape.first);
+        CHECK(height == s.shape.second);
+        CHECK(depth == 255);
+        for (auto const& pix : s.frame) {
+            int r, g, b;
+            is >> r >> g >> b;
+            CHECK(r == pix.getRed().getValue());
+            CHECK(g == pix.getGreen().getValue());
+            CHECK(b == pix.getBlue().getValue());
+        }
+        int trailing;
+        CHECK_FALSE(bool(is >> trailing));
+
+        std::istringstream lines(os.str());
+        size_t n_lines = 0;
+        while (std::getline(lines, line)) {
+            CHECK(line.size() <= 70);
+            CHECK(line.back() != ' ');
+            ++n_lines;
+        }
+        CHECK(n_lines >= s.shape.second + 3);
+    }
+
+    pixmap<gray16 const *> pmap(deep.data(), std::make_pair(deep.size(), 1));
+    std::ostringstream os;
+    pmap.write_ascii(os);
+    std::istringstream is(os.str());
+    std::string magic;
+    size_t width, height, depth;
+    is >> magic >> width >> height >> depth;
+    CHECK(magic == "P2");
+    CHECK(depth == 65535);
+    for (auto const& pix : deep) {
+        unsigned v;
+        is >> v;
+        CHECK(v == pix.getValue());
+    }
+}
+
+namespace {
+    // fails every write after the first `capacity` bytes
+    struct failing_buf : std::streambuf {
+        explicit failing_buf (size_t capacity) : capacity(capacity) {}
+
+    protected:
+        std::streamsize xsputn (char const *, std::streamsize n) override {
+            if (size_t(n) > capacity)
+                return 0;
+            capacity -= n;
+            return n;
+        }
+
+        int_type overflow (int_type ch) override {
+            return xsputn(nullptr, 1) == 1 ? ch : traits_type::eof();
+        }
+
+    private:
+        size_t capacity;
+    };
+}
+
+TEST_CASE("write-async") {
+    for (auto shape : {std::make_pair(1, 1), std::make_pair(37, 5),
+                       std::make_pair(3000, 40), std::make_pair(0, 3)}) {
+        scene s(shape.first, shape.second);
+        auto mapped = itadpt::map(s.values, s.palette);
+        pixmap<decltype(mapped.begin())> from_values(mapped.begin(), s.shape);
+        pixmap<rgb const *> from_pointer(s.frame.data(), s.shape);
+        std::list<rgb> forward_only(s.frame.begin(), s.frame.end());
+        pixmap<std::list<rgb>::const_iterator> from_list(forward_only.cbegin(), s.shape);
+
+        for (size_t buffers : {1, 2, 4}) {
+            for (size_t band_size : {1, 1000, 1 << 20}) {
+                std::ostringstream values_os, pointer_os, list_os;
+                async_pixmap_writer<decltype(mapped.begin())> values_writer(
+                    from_values, values_os, buffers, band_size);
+                async_pixmap_writer<rgb const *> pointer_writer(
+                    from_pointer, pointer_os, buffers, band_size);
+                async_pixmap_writer<std::list<rgb>::const_iterator> list_writer(
+                    from_list, list_os, buffers, band_size);
+                values_writer.write();
+                pointer_writer.write();
+                while (list_writer.write_band())
+                    CHECK(list_writer.pending() <= buffers);
+                CHECK(list_writer.done());
+                list_writer.wait();
+                CHECK(values_os.str() == s.reference());
+                CHECK(pointer_os.str() == s.reference());
+                CHECK(list_os.str() == s.reference());
+            }
+        }
+    }
+
+    scene s(300, 200);
+    pixmap<rgb const *> pmap(s.frame.data(), s.shape);
+    for (size_t capacity : {0, 5000}) {
+        failing_buf buf(capacity);
+        std::ostream os(&buf);
+        async_pixmap_writer<rgb const *> writer(pmap, os, 2, 1000);
+        CHECK_THROWS_AS(writer.write(), std::runtime_error);
+        CHECK(writer.done());
+        CHECK_FALSE(writer.write_band());
+    }
+    {
+        // destroyed without waiting
+        std::ostringstream os;
+        async_pixmap_writer<rgb const *> writer(pmap, os, 2, 1000);
+        writer.write_band();
+    }
+    {
+        // rows left after closing cannot be written any more
+        std::ostringstream os;
+        async_pixmap_writer<rgb const *> writer(pmap, os, 2, 1000);
+        writer.write_band();
+        writer.wait();
+        CHECK_FALSE(writer.done());
+        CHECK_THROWS_AS(writer.write_band(), std::logic_error);
+        CHECK_THROWS_AS(writer.write(), std::logic_error);
+        CHECK(os.str().size() < s.reference().size());
+    }
+}
+
+#ifdef COLORMAP_HAVE_DIRECT_IO
+
+TEST_CASE("write-direct") {
+    std::vector<scene> scenes;
+    for (auto shape : {std::make_pair(1, 1), std::make_pair(37, 5), std::make_pair(3000, 40),
+                       std::make_pair(0, 3), std::make_pair(256, 256)})
+        scenes.emplace_back(shape.first, shape.second);
+
+    for (size_t queue_depth : {1, 3}) {
+        for (size_t buffer_size : {4096, 1 << 20}) {
+            direct_pixmap_writer writer(queue_depth, buffer_size);
+            std::vector<std::string> paths;
+            for (size_t i = 0; i < scenes.size(); ++i) {
+                scene const& s = scenes[i];
+                auto mapped = itadpt::map(s.values, s.palette);
+                pixmap<decltype(mapped.begin())> from_values(mapped.begin(), s.shape);
+                pixmap<rgb const *> from_pointer(s.frame.data(), s.shape);
+                std::list<rgb> forward_only(s.frame.begin(), s.frame.end());
+                pixmap<std::list<rgb>::const_iterator> from_list(forward_only.cbegin(), s.shape);
+                std::string stem = "write-direct-" + std::to_string(i);
+                writer.write(from_values, stem + "-values.ppm");
+                writer.write(from_pointer, stem + "-pointer.ppm");
+                writer.write(from_list, stem + "-list.ppm");
+                CHECK(writer.pending() <= queue_depth + 1);
+            }
+            writer.wait();
+            CHECK(writer.pending() == 0);
+            for (size_t i = 0; i < scenes.size(); ++i) {
+                std::string stem = "write-direct-" + std::to_string(i);
+                for (std::string kind : {"-values.ppm", "-pointer.ppm", "-list.ppm"})
+                    CHECK(scene::read_file(stem + kind) == scenes[i].reference());
+            }
+        }
+    }
+
+    direct_pixmap_writer writer;
+    pixmap<rgb const *> pmap(scenes[0].frame.data(), scenes[0].shape);
+    CHECK_THROWS_AS(writer.write(pmap, "nonexistent-dir/out.ppm"), std::runtime_error);
+    writer.write(pmap, "write-direct.ppm");
+    writer.wait();
+    CHECK(scene::read_file("write-direct.ppm") == scenes[0].reference());
+}
+
+#endif // COLORMAP_HAVE_DIRECT_IO
+
+TEST_CASE("write-pam") {
+    using rgba = color<space::rgba>;
+    using rgb16 = color<space::rgb, std::uint16_t>;
+    using gray16 = color<space::grayscale, std::uint16_t>;
+
+    for (auto shape : {std::make_pair(1, 1), std::make_pair(37, 5), std::make_pair(300, 40)}) {
+        size_t n = shape.first * shape.second;
+        std::vector<rgba> translucent;
+        std::vector<rgb16> deep;
+        std::string expected_rgba, expected_deep;
+        for (size_t i = 0; i < n; ++i) {
+            translucent.push_back(rgba {std::uint8_t(i), std::uint8_t(i / 3),
+                                        std::uint8_t(255 - i), std::uint8_t(i * 7)});
+            deep.push_back(rgb16 {std::uint16_t(i * 131), std::uint16_t(65535 - i),
+                                  std::uint16_t(i * i)});
+            for (size_t k = 0; k < 4; ++k)
+                expected_rgba += char(translucent[i].getChannel(k).getValue());
+            for (size_t k = 0; k < 3; ++k) {
+                std::uint16_t v = deep[i].getChannel(k).getValue();
+                expected_deep += char(v >> 8);
+                expected_deep += char(v & 0xFF);
+            }
+        }
+        auto pam_header = [&] (size_t depth, size_t maxval, std::string const& tuple_type) {
+            std::ostringstream os;
+            os << "P7\nWIDTH " << shape.first << "\nHEIGHT " << shape.second
+               << "\nDEPTH " << depth << "\nMAXVAL " << maxval
+               << "\nTUPLTYPE " << tuple_type << "\nENDHDR\n";
+            return os.str();
+        };
+
+        pixmap<rgba const *> from_rgba(translucent.data(), shape);
+        std::ostringstream pam, binary;
+        from_rgba.write_pam(pam);
+        from_rgba.write_binary(binary);
+        CHECK(pam.str() == pam_header(4, 255, "RGB_ALPHA") + expected_rgba);
+        CHECK(binary.str() == pam.str());
+        CHECK(from_rgba.file_extension() == "pam");
+
+        // 16-bit samples are big-endian, whether byte-swapped in bulk or
+        // written pixel by pixel
+        pixmap<std::vector<rgb16>::const_iterator> from_vector(deep.cbegin(), shape);
+        std::list<rgb16> forward_only(deep.begin(), deep.end());
+        pixmap<std::list<rgb16>::const_iterator> from_list(forward_only.cbegin(), shape);
+        std::string deep_pam = pam_header(3, 65535, "RGB") + expected_deep;
+        std::ostringstream ppm_header;
+        ppm_header << "P6\n" << shape.first << ' ' << shape.second << "\n65535\n";
+        CHECK(scene::binary(from_vector) == ppm_header.str() + expected_deep);
+        CHECK(scene::binary(from_list) == ppm_header.str() + expected_deep);
+        std::ostringstream from_vector_pam, from_list_pam;
+        from_vector.write_pam(from_vector_pam);
+        from_list.write_pam(from_list_pam);
+        CHECK(from_vector_pam.str() == deep_pam);
+        CHECK(from_list_pam.str() == deep_pam);
+
+        std::string path = "write-pam.pam";
+        from_rgba.write_mmap(path);
+        CHECK(scene::read_file(path) == pam.str());
+        from_vector.write_mmap(path, 2);
+        CHECK(scene::read_file(path) == ppm_header.str() + expected_deep);
+    }
+
+    std::vector<gray16> gray {gray16 {0x0102}, gray16 {0xA0B0}};
+    pixmap<gray16 const *> from_gray(gray.data(), std::make_pair(2, 1));
+    std::ostringstream pam;
+    from_gray.write_pam(pam);
+    CHECK(pam.str() == "P7\nWIDTH 2\nHEIGHT 1\nDEPTH 1\nMAXVAL 65535\n"
+                       "TUPLTYPE GRAYSCALE\nENDHDR\n\x01\x02\xA0\xB0");
+    CHECK(detail::is_swapped_contiguous<gray16 const *>::value);
+    std::string bytes;
+    for (size_t i = 0; i < 2 * 45; ++i)
+        bytes += char(i);
+    std::string swapped = bytes;
+    detail::byteswap16(&swapped[0], 45);
+    for (size_t i = 0; i < 45; ++i)
+        CHECK(swapped.substr(2 * i, 2) == std::string {bytes[2*i+1], bytes[2*i]});
+#ifdef COLORMAP_X86_DISPATCH
+    if (detail::cpu_has_ssse3()) {
+        std::string ssse3 = bytes;
+        detail::byteswap16_ssse3(&ssse3[0], 45);
+        CHECK(ssse3 == swapped);
+    }
+#endif
+    CHECK_FALSE(detail::is_swapped_contiguous<rgb const *>::value);
+
+    std::vector<rgba> one(1);
+    pixmap<rgba const *> plain(one.data(), std::make_pair(1, 1));
+    std::ostringstream os;
+    CHECK_THROWS_AS(plain.write_ascii(os), std::runtime_error);
+}
+
+#ifdef COLORMAP_WITH_ZLIB
+
+namespace {
+    // Minimal PNG decoder for non-interlaced images: returns the raw samples
+    // after checking the chunk CRCs and undoing the row filters.
+    std::vector<unsigned char> decode_png (std::string const& png, size_t & width,
+                                           size_t & height, int & bit_depth,
+                                           int & color_type,
+                                           std::string * plte = nullptr,
+                                           std::string * trns = nullptr)
+    {
+        auto be32 = [&] (size_t pos) {
+            return std::uint32_t((unsigned char)png[pos]) << 24
+                 | std::uint32_t((unsigned char)png[pos+1]) << 16
+                 | std::uint32_t((unsigned char)png[pos+2]) << 8
+                 | std::uint32_t((unsigned char)png[pos+3]);
+        };
+        REQUIRE(png.compare(0, 8, "\x89PNG\r\n\x1a\n") == 0);
+        std::string idat;
+        for (size_t pos = 8; pos < png.size(); ) {
+            std::uint32_t len = be32(pos);
+            std::string type = png.substr(pos + 4, 4);
+            auto data = reinterpret_cast<unsigned char const *>(png.data() + pos + 8);
+            std::uint32_t crc = std::uint32_t(::crc32(0, data - 4, len + 4));
+            CHECK(crc == be32(pos + 8 + len));
+            if (type == "IHDR") {
+                width = be32(pos + 8);
+                height = be32(pos + 12);
+                bit_depth = data[8];
+                color_type = data[9];
+            } else if (type == "PLTE" && plte) {
+                plte->assign(png, pos + 8, len);
+            } else if (type == "tRNS" && trns) {
+                trns->assign(png, pos + 8, len);
+            } else if (type == "IDAT") {
+                idat.append(png, pos + 8, len);
+            } else if (type == "IEND") {
+                CHECK(pos + 12 == png.size());
+            }
+            pos += 12 + len;
+        }
+        size_t channels = color_type == 2 ? 3 : color_type == 6 ? 4 : 1;
+        size_t bpp = channels * bit_depth / 8;
+        size_t stride = width * bpp;
+        std::vector<unsigned char> filtered((stride + 1) * height);
+        uLongf size = filtered.size();
+        REQUIRE(::uncompress(filtered.data(), &size,
+                             reinterpret_cast<Bytef const *>(idat.data()), idat.size()) == Z_OK);
+        REQUIRE(size == filtered.size());
+
+        std::vector<unsigned char> raw(stride * height);
+        std::vector<unsigned char> zero(stride, 0);
+        for (size_t y = 0; y < height; ++y) {
+            unsigned char const * f = filtered.data() + y * (stride + 1);
+            unsigned char * cur = raw.data() + y * stride;
+            unsigned char const * prev = y > 0 ? cur - stride : zero.data();
+            for (size_t i = 0; i < stride; ++i) {
+                int a = i >= bpp ? cur[i - bpp] : 0;
+                int b = prev[i];
+                int c = i >= bpp ? prev[i - bpp] : 0;
+                int pred = 0;
+                switch (f[0]) {
+                case 1: pred = a; break;
+                case 2: pred = b; break;
+                case 3: pred = (a + b) / 2; break;
+                case 4: pred = detail::paeth(a, b, c); break;
+                }
+                cur[i] = (unsigned char)(f[i + 1] + pred);
+            }
+        }
+        return raw;
+    }
+
+    template <typename Writer>
+    std::string png_bytes (Writer const& writer, png_encoder encoder, size_t threads) {
+        std::ostringstream os;
+        writer.write(os, encoder, threads);
+        return os.str();
+    }
+}
+
+TEST_CASE("write-png") {
+    for (auto shape : {std::make_pair(1, 1), std::make_pair(37, 5),
+                       std::make_pair(3000, 70), std::make_pair(400, 1000)}) {
+        scene s(shape.first, shape.second);
+        std::vector<unsigned char> expected;
+        for (auto const& pix : s.frame)
+            for (size_t k = 0; k < 3; ++k)
+                expected.push_back(pix.getChannel(k).getValue());
+
+        auto mapped = itadpt::map(s.values, s.palette);
+        png_writer<decltype(mapped.begin())> from_values(mapped.begin(), s.shape);
+        std::list<rgb> forward_only(s.frame.begin(), s.frame.end());
+        png_writer<std::list<rgb>::const_iterator> from_list(forward_only.cbegin(), s.shape);
+
+        for (auto encoder : {png_encoder::automatic, png_encoder::zlib,
+                             png_encoder::fixed_huffman, png_encoder::stored}) {
+            for (size_t threads : {1, 3}) {
+                for (auto const& png : {png_bytes(from_values, encoder, threads),
+                                        png_bytes(from_list, encoder, threads)}) {
+                    size_t width, height;
+                    int bit_depth, color_type;
+                    CHECK(decode_png(png, width, height, bit_depth, color_type) == expected);
+                    CHECK(width == s.shape.first);
+                    CHECK(height == s.shape.second);
+                    CHECK(bit_depth == 8);
+                    CHECK(color_type == 2);
+                }
+            }
+        }
+        CHECK(from_values.file_extension() == "png");
+    }
+
+    using rgba16 = color<space::rgba, std::uint16_t>;
+    std::vector<rgba16> deep;
+    for (std::uint32_t i = 0; i < 5000; ++i)
+        deep.push_back(rgba16 {std::uint16_t(i * 13), std::uint16_t(65535 - i),
+                               std::uint16_t(i * i), std::uint16_t(i % 7 * 9000)});
+    png_writer<rgba16 const *> deep_writer(deep.data(), std::make_pair(100, 50));
+    size_t width, height;
+    int bit_depth, color_type;
+    auto raw = decode_png(png_bytes(deep_writer, png_encoder::fixed_huffman, 2),
+                          width, height, bit_depth, color_type);
+    CHECK(bit_depth == 16);
+    CHECK(color_type == 6);
+    for (size_t i = 0; i < deep.size(); ++i)
+        for (size_t k = 0; k < 4; ++k)
+            CHECK((raw[8 * i + 2 * k] << 8 | raw[8 * i + 2 * k + 1])
+                  == deep[i].getChannel(k).getValue());
+
+    std::vector<color<space::grayscale>> gray(64 * 64, color<space::grayscale> {7});
+    png_writer<color<space::grayscale> const *> gray_writer(gray.data(), std::make_pair(64, 64));
+    raw = decode_png(png_bytes(gray_writer, png_encoder::automatic, 0),
+                     width, height, bit_depth, color_type);
+    CHECK(color_type == 0);
+    CHECK(raw == std::vector<unsigned char>(64 * 64, 7));
+
+    png_writer<rgb const *> empty(nullptr, std::make_pair(0, 10));
+    std::ostringstream os;
+    CHECK_THROWS_AS(empty.write(os), std::runtime_error);
+}
+
+TEST_CASE("write-png-indexed") {
+    scene s(300, 200);
+    auto baked = s.palette.bake(256);
+    std::vector<std::uint8_t> indices(s.values.size());
+    baked.apply_indices(s.values, indices);
+    for (size_t i = 0; i < s.values.size(); i += 97)
+        CHECK(indices[i] == baked.index(s.values[i]));
+
+    png_writer<std::uint8_t const *> writer(indices.data(), s.shape, baked.colors());
+    for (size_t threads : {1, 2}) {
+        size_t width, height;
+        int bit_depth, color_type;
+        std::string plte, trns = "untouched";
+        auto raw = decode_png(png_bytes(writer, png_encoder::automatic, threads),
+                              width, height, bit_depth, color_type, &plte, &trns);
+        CHECK(bit_depth == 8);
+        CHECK(color_type == 3);
+        CHECK(raw == std::vector<unsigned char>(indices.begin(), indices.end()));
+        REQUIRE(plte.size() == 3 * 256);
+        for (size_t i = 0; i < 256; ++i)
+            for (size_t k = 0; k < 3; ++k)
+                CHECK((unsigned char)plte[3 * i + k]
+                      == baked.colors()[i].getChannel(k).getValue());
+        CHECK(trns == "untouched");     // opaque palettes need no tRNS chunk
+    }
+
+    // categorical labels with a translucent palette
+    using rgba = color<space::rgba>;
+    categorical_map<rgba> classes {rgba {255, 0, 0, 255}, rgba {0, 255, 0, 128},
+                                   rgba {0, 0, 255, 255}};
+    std::vector<int> labels {0, 1, 2, 3, 4, 5, -1, 7};
+    std::vector<std::uint8_t> class_indices(labels.size());
+    classes.apply_indices(labels, class_indices);
+    CHECK(classes.index(-1) == 2);
+    png_writer<std::uint8_t const *> class_writer(class_indices.data(),
+                                                  std::make_pair(4, 2), classes.colors());
+    size_t width, height;
+    int bit_depth, color_type;
+    std::string plte, trns;
+    auto raw = decode_png(png_bytes(class_writer, png_encoder::fixed_huffman, 1),
+                          width, height, bit_depth, color_type, &plte, &trns);
+    CHECK(raw == std::vector<unsigned char>({0, 1, 2, 0, 1, 2, 2, 1}));
+    CHECK(plte == std::string("\xff\0\0\0\xff\0\0\0\xff", 9));
+    CHECK(trns == std::string("\xff\x80", 2));
+
+    std::uint8_t bad[] = {0, 3};
+    png_writer<std::uint8_t const *> bad_writer(bad, std::make_pair(2, 1), classes.colors());
+    std::ostringstream os;
+    CHECK_THROWS_AS(bad_writer.write(os), std::out_of_range);
+    png_writer<std::uint8_t const *> no_palette(bad, std::make_pair(2, 1));
+    CHECK_THROWS_AS(no_palette.write(os), std::runtime_error);
+    CHECK_THROWS_AS(s.palette.bake(257).apply_indices(s.values, indices),
+                    std::runtime_error);
+}
+
+TEST_CASE("deflate-zlib-segments") {
+    // incompressible segments, compressed independently with the preceding
+    // data as history, need to concatenate to one valid raw DEFLATE stream
+    std::vector<unsigned char> data(300000);
+    std::uint32_t state = 1;
+    for (auto & byte : data) {
+        state = state * 1664525u + 1013904223u;
+        byte = (unsigned char)(state >> 24);
+    }
+    std::vector<size_t> bounds {0, 0, 1, 7, 70000, 70000, 200000, 300000};
+    for (int level : {0, 1, 9}) {
+        std::vector<unsigned char> stream {0xAB};   // must be kept
+        for (size_t i = 0; i + 1 < bounds.size(); ++i)
+            detail::deflate_zlib(data.data(), bounds[i], bounds[i + 1],
+                                 i + 2 == bounds.size(), level, stream);
+        REQUIRE(stream[0] == 0xAB);
+
+        z_stream zs {};
+        REQUIRE(inflateInit2(&zs, -15) == Z_OK);
+        std::vector<unsigned char> inflated(data.size() + 1);
+        zs.next_in = stream.data() + 1;
+        zs.avail_in = uInt(stream.size() - 1);
+        zs.next_out = inflated.data();
+        zs.avail_out = uInt(inflated.size());
+        CHECK(inflate(&zs, Z_FINISH) == Z_STREAM_END);
+        CHECK(zs.avail_in == 0);
+        CHECK(zs.total_out == data.size());
+        inflateEnd(&zs);
+        inflated.resize(data.size());
+        CHECK(inflated == data);
+    }
+}
+
+#endif // COLORMAP_WITH_ZLIB
@@ -0,0 +1,223 @@
+// colormap -- color palettes, map iterators, grids, and PPM export
+// Copyright (C) 2018-2019  Jonas Greitemann
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+#define DOCTEST_CONFIG_IMPLEMENT_WITH_MAIN
+
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <doctest/doctest.h>
+
+#include <colormap/map.hpp>
+#include <colormap/palettes.hpp>
+#include <colormap/pixmap.hpp>
+#include <colormap/pixmap_view.hpp>
+#include <colormap/itadpt/map_iterator_adapter.hpp>
+
+
+using namespace colormap;
+using rgb = color<space::rgb>;
+using rgba = color<space::rgba>;
+using gray = color<space::grayscale>;
+using rgb16 = color<space::rgb, std::uint16_t>;
+
+namespace {
+    struct temp_file {
+        temp_file (std::string const& path, std::string const& content) : path(path) {
+            std::ofstream os(path, std::ios_base::binary);
+            os << content;
+        }
+
+        ~temp_file () {
+            std::remove(path.c_str());
+        }
+
+        std::string path;
+    };
+
+    template <typename Color>
+    bool same_channels (Color const& a, Color const& b) {
+        for (size_t k = 0; k < detail::channel_traits<Color>::count; ++k)
+            if (detail::channel_traits<Color>::get(a, k) != detail::channel_traits<Color>::get(b, k))
+                return false;
+        return true;
+    }
+
+    template <typename Color, typename Container>
+    void check_pixels (pixmap_view<Color> const& view, Container const& expected) {
+        REQUIRE(view.size() == expected.size());
+        size_t i = 0;
+        for (auto pix : view)
+            CHECK(same_channels(pix, expected[i++]));
+        CHECK(view.end() - view.begin() == std::ptrdiff_t(expected.size()));
+    }
+}
+
+TEST_CASE("open-binary") {
+    const size_t width = 37, height = 11;
+    std::vector<double> values(width * height);
+    for (size_t i = 0; i < values.size(); ++i)
+        values[i] = double(i % width) / width + double(i / width) / height;
+    auto palette = palettes.at("viridis").rescale(0., 2.);
+    std::vector<rgb> frame(values.size());
+    palette.apply(values, frame);
+
+    std::ostringstream ppm;
+    pixmap<rgb const *>(frame.data(), std::make_pair(width, height)).write_binary(ppm);
+    temp_file file("open-binary.ppm", ppm.str());
+    auto view = pixmap_view<rgb>::open(file.path);
+    CHECK(view.shape() == std::make_pair(width, height));
+    CHECK(view.maxval() == 255);
+    check_pixels(view, frame);
+    CHECK(same_channels(view(5, 3), frame[3 * width + 5]));
+    CHECK(std::memcmp(view.data(), frame.data(), view.size_bytes()) == 0);
+
+    // writing the view reproduces the file
+    pixmap<pixmap_view<rgb>::const_iterator> rewritten(view.begin(), view.shape());
+    std::ostringstream again;
+    rewritten.write_binary(again);
+    CHECK(again.str() == ppm.str());
+
+    // recover the data and recolor it with a different palette
+    auto inverse = palette.inverse();
+    auto recovered = itadpt::map(view, inverse);
+    std::vector<double> data(recovered.begin(), recovered.end());
+    for (size_t i = 0; i < values.size(); ++i)
+        CHECK(data[i] == doctest::Approx(values[i]).epsilon(0.02));
+    auto magma = palettes.at("magma").rescale(0., 2.);
+    auto recolored = itadpt::map(data, magma);
+    CHECK(same_channels(*recolored.begin(), magma(data[0])));
+
+    // 16-bit samples are big-endian
+    std::vector<rgb16> deep;
+    for (std::uint32_t i = 0; i < 300; ++i)
+        deep.push_back(rgb16 {std::uint16_t(i * 211), std::uint16_t(65535 - i), std::uint16_t(i)});
+    std::ostringstream deep_ppm;
+    pixmap<rgb16 const *>(deep.data(), std::make_pair(20, 15)).write_binary(deep_ppm);
+    temp_file deep_file("open-binary-16.ppm", deep_ppm.str());
+    auto deep_view = pixmap_view<rgb16>::open(deep_file.path);
+    CHECK(deep_view.maxval() == 65535);
+    check_pixels(deep_view, deep);
+
+    // PAM with alpha channel
+    std::vector<rgba> translucent;
+    for (std::uint32_t i = 0; i < 64; ++i)
+        translucent.push_back(rgba {std::uint8_t(i), std::uint8_t(2 * i), std::uint8_t(3 * i),
+                                    std::uint8_t(255 - i)});
+    std::ostringstream pam;
+    pixmap<rgba const *>(translucent.data(), std::make_pair(8, 8)).write_pam(pam);
+    temp_file pam_file("open-binary.pam", pam.str());
+    check_pixels(pixmap_view<rgba>::open(pam_file.path), translucent);
+
+    std::ostringstream gray_pam;
+    std::vector<gray> shades {gray {0}, gray {7}, gray {255}};
+    pixmap<gray const *>(shades.data(), std::make_pair(3, 1)).write_pam(gray_pam);
+    temp_file gray_file("open-binary-gray.pam", gray_pam.str());
+    check_pixels(pixmap_view<gray>::open(gray_file.path), shades);
+}
+
+TEST_CASE("open-plain") {
+    std::vector<rgb> frame;
+    for (std::uint32_t i = 0; i < 200; ++i)
+        frame.push_back(rgb {std::uint8_t(i), std::uint8_t(i * 7), std::uint8_t(255 - i)});
+    std::ostringstream ppm;
+    pixmap<rgb const *>(frame.data(), std::make_pair(20, 10)).write_ascii(ppm);
+    temp_file file("open-plain.ppm", ppm.str());
+    auto view = pixmap_view<rgb>::open(file.path);
+    CHECK(view.shape() == std::make_pair<size_t, size_t>(20, 10));
+    check_pixels(view, frame);
+
+    temp_file commented("open-plain.pgm", "P2\n# a comment\n3 # width\n2\n# maxval next\n"
+                                          "15\n0 1 2\n13 14\n15");
+    check_pixels(pixmap_view<gray>::open(commented.path),
+                 std::vector<gray> {gray {0}, gray {17}, gray {34}, gray {221}, gray {238}, gray {255}});
+
+    temp_file deep("open-plain-16.pgm", "P2 2 1 1000 999 1000\n");
+    check_pixels(pixmap_view<color<space::grayscale, std::uint16_t>>::open(deep.path),
+                 std::vector<color<space::grayscale, std::uint16_t>> {{65469}, {65535}});
+}
+
+TEST_CASE("open-maxval") {
+    // 4-bit samples are rescaled to the full 8-bit range
+    std::string nibbles = "P5\n4 2\n15\n";
+    for (char v : {0, 1, 7, 8, 14, 15, 16, 255})
+        nibbles += v;
+    temp_file shallow("open-maxval.pgm", nibbles);
+    auto view = pixmap_view<gray>::open(shallow.path);
+    CHECK(view.maxval() == 15);
+    check_pixels(view, std::vector<gray> {gray {0}, gray {17}, gray {119}, gray {136},
+                                          gray {238}, gray {255}, gray {255}, gray {255}});
+    CHECK(view.data()[2] == 7);
+
+    // 12-bit samples are rescaled to the full 16-bit range
+    using gray16 = color<space::grayscale, std::uint16_t>;
+    std::string deep = "P5\n3 1\n4095\n";
+    for (std::uint32_t v : {0u, 2048u, 4095u}) {
+        deep += char(v >> 8);
+        deep += char(v & 0xFF);
+    }
+    temp_file deep_file("open-maxval-16.pgm", deep);
+    check_pixels(pixmap_view<gray16>::open(deep_file.path),
+                 std::vector<gray16> {{0}, {32776}, {65535}});
+
+    // a 7-bit image written back out has full-range 8-bit samples
+    temp_file plain("open-maxval.ppm", "P3 2 1 127 0 64 127 127 1 0\n");
+    auto rgb_view = pixmap_view<rgb>::open(plain.path);
+    std::vector<rgb> expected {rgb {0, 129, 255}, rgb {255, 2, 0}};
+    check_pixels(rgb_view, expected);
+    std::ostringstream out;
+    pixmap<pixmap_view<rgb>::const_iterator>(rgb_view.begin(), rgb_view.shape()).write_binary(out);
+    CHECK(out.str() == std::string("P6\n2 1\n255\n\x00\x81\xff\xff\x02\x00", 17));
+}
+
+TEST_CASE("iterator-arrow") {
+    temp_file file("iterator-arrow.ppm", "P3 2 1 255 1 2 3 4 5 6\n");
+    auto view = pixmap_view<rgb>::open(file.path);
+    auto it = view.begin();
+    CHECK(it->getRed().getValue() == 1);
+    CHECK((it + 1)->getBlue().getValue() == 6);
+    static_assert(sizeof(pixmap_view<rgb>::const_iterator::pointer) == sizeof(rgb),
+                  "the arrow proxy holds nothing but the color");
+}
+
+TEST_CASE("open-errors") {
+    auto fails = [] (std::string const& content, bool rgb_view) {
+        temp_file file("open-errors.pnm", content);
+        if (rgb_view)
+            CHECK_THROWS_AS(pixmap_view<rgb>::open(file.path), std::runtime_error);
+        else
+            CHECK_THROWS_AS(pixmap_view<gray>::open(file.path), std::runtime_error);
+    };
+    fails("P6\n2 2\n255\n", false);                 // wrong color type
+    fails("P6\n2 2\n255\nabcdefghijk", true);       // truncated
+    fails("P6\n2 2\n65535\n", true);                // 16-bit samples
+    fails("P5\n2 2\n0\nabcd", false);               // invalid maxval
+    fails("P4\n2 2\n", false);                      // bitmaps are not supported
+    fails("GIF89a", true);
+    fails("P3\n1 1\n255\n1 2", true);               // truncated plain file
+    fails("P2\n1 1\n255\n256", false);              // sample exceeds maxval
+    fails("P7\nWIDTH 1\nHEIGHT 1\nDEPTH 3\nMAXVAL 255\nTUPLTYPE RGB\n", true);
+    fails("P7\nWIDTH 1\nHEIGHT 1\nDEPTH 3\nTUPLTYPE RGB\nENDHDR\nabc", true);
+    fails("P7\nWIDTH 1\nHEIGHT 1\nDEPTH 3\nMAXVAL 255\nTUPLTYPE YCbCr\nENDHDR\nabc", true);
+    fails("P6\n4294967295 4294967295\n255\n", true);
+    CHECK_THROWS_AS(pixmap_view<rgb>::open("nonexistent.ppm"), std::runtime_error);
+}